@@ -8,19 +8,19 @@ private:
 private:
     void OnConnected(const PtrConnection &conn)
     {
-        DF_DEBUG("新建连接, id: %d", conn->Id());
+        DF_DEBUG("新建连接, id: %" PRIu64, conn->Id());
     }
     void OnClosed(const PtrConnection &conn)
     {
-        DF_DEBUG("关闭连接, id: %d", conn->Id());
+        DF_DEBUG("关闭连接, id: %" PRIu64, conn->Id());
     }
     void MessageHandler(const PtrConnection &conn, Buffer &buf)
     {
         // 获取消息
         std::string msg = buf.readAsString(buf.readableBytes());
         // 回显消息
-        conn->send(msg.c_str(), msg.size());
-        DF_DEBUG("ECHO SUCCESSED, CLIENT ID: %d", conn->Id());
+        conn->send(std::move(msg));
+        DF_DEBUG("ECHO SUCCESSED, CLIENT ID: %" PRIu64, conn->Id());
         // here
         // 关闭客户端
         conn->shutdown();
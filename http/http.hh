@@ -9,6 +9,7 @@
 #include <filesystem>
 #include <regex>
 #include <cstring>
+#include <string_view>
 #include "../src/server.hh"
 
 #include "../logger/ckflog.hpp"
@@ -120,8 +121,14 @@ public:
     // URL解码
     static std::string urlDecode(const std::string url, bool convertPlus = false)
     {
-        // 遇到%就解码(将紧随其后的两个数字转换为字符)，遇到+就替换为空格
         std::string result;
+        urlDecode(url, result, convertPlus);
+        return result;
+    }
+    // URL解码，结果追加到result中（调用者可以复用result的空间）
+    // 遇到%就解码(将紧随其后的两个十六进制数字转换为字符)，遇到+就替换为空格，%后面不是两个十六进制数字时原样保留
+    static void urlDecode(std::string_view url, std::string &result, bool convertPlus = false)
+    {
         size_t i = 0;
         while (i < url.size())
         {
@@ -131,12 +138,10 @@ public:
                 i++;
                 continue;
             }
-
-            if (url[i] == '%')
+            int hi, lo;
+            if (url[i] == '%' && i + 2 < url.size() && (hi = hexValue(url[i + 1])) >= 0 && (lo = hexValue(url[i + 2])) >= 0)
             {
-                assert(i + 2 < url.size()); // 至少还有两个字符
-                char c = (char)std::stoi(url.substr(i + 1, 2), nullptr, 16);
-                result += c;
+                result += (char)(hi * 16 + lo);
                 i += 3;
             }
             else
@@ -145,7 +150,27 @@ public:
                 i++;
             }
         }
-        return result;
+    }
+    static int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F')
+        {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+    // 忽略大小写比较
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
     }
 
     // 获取响应状态码对应的描述信息
@@ -381,7 +406,7 @@ public:
 
         // 2.遍历每个子目录，以计算路径深度
         int depth = 0;
-        for (int i = 0; i < dirs.size(); i++)
+        for (size_t i = 0; i < dirs.size(); i++)
         {
             if (dirs[i] == ".")
             {
@@ -406,118 +431,287 @@ public:
 }; // Util
 
 // http请求信息模块
+// 请求行和头部（请求首部）原文整体保存在_head中，方法、路径、查询字符串、版本和各个头部只记录在_head中的位置
+// 路径和查询参数在第一次访问时才解码；同一连接上的请求复用同一个对象和其中容器的空间，稳定状态下解析请求不分配内存
 class HttpRequest
 {
+    friend class HttpContext;
+
 public:
-    std::string _method;                                        // 请求方法
-    std::string _url;                                           // 请求URL
-    std::smatch _matches;                                       // URL正则匹配结果
-    std::string _resource_path;                                 // 请求资源路径 (从URL中解析)
-    std::string _version;                                       // HTTP版本
-    std::string _body;                                          // 请求体
-    std::unordered_map<std::string, std::string> _headers;      // 请求头
-    std::unordered_map<std::string, std::string> _query_params; // 请求查询参数（从查询字符串中解析）
+    // 请求首部中的一段（相对_head开头的偏移和长度）
+    struct Span
+    {
+        uint32_t off = 0;
+        uint32_t len = 0;
+    };
+    struct HeaderSpan
+    {
+        Span name;
+        Span value;
+    };
+
+public:
+    std::smatch _matches; // URL正则匹配结果
+    std::string _body;    // 请求体
+
+private:
+    std::string _head;                 // 请求首部原文
+    std::string_view _method;          // 请求方法（指向静态字符串，统一为大写）
+    Span _path;                        // 资源路径（未解码）
+    Span _query;                       // 查询字符串（未解码，不含'?'）
+    Span _version;                     // HTTP版本，如"HTTP/1.1"
+    std::vector<HeaderSpan> _headers;  // 请求头
+    std::vector<HeaderSpan> _trailers; // 尾部字段（分块传输的请求体之后），原文追加在_head末尾
+
+    mutable bool _path_decoded = false;                                     // 资源路径是否已解码
+    mutable std::string _resource_path;                                     // 解码后的资源路径
+    mutable bool _params_decoded = false;                                   // 查询参数是否已解码
+    mutable std::vector<std::pair<std::string, std::string>> _query_params; // 解码后的查询参数
+
+private:
+    std::string_view view(Span span) const
+    {
+        // 首部还没有解析完（如解析出错时）_head为空，各段都返回空
+        if (span.off + span.len > _head.size())
+        {
+            return std::string_view();
+        }
+        return std::string_view(_head.data() + span.off, span.len);
+    }
+    // 按名字查找头部字段（忽略大小写），请求头一般只有十几个，顺序查找即可
+    const HeaderSpan *findHeader(std::string_view key) const
+    {
+        return findField(_headers, key);
+    }
+    const HeaderSpan *findField(const std::vector<HeaderSpan> &fields, std::string_view key) const
+    {
+        for (auto &h : fields)
+        {
+            if (Util::equalsIgnoreCase(view(h.name), key))
+            {
+                return &h;
+            }
+        }
+        return nullptr;
+    }
+    // 按'&'和'='拆分查询字符串并解码（'+' -> ' '），键或值为空的参数忽略
+    void decodeParams() const
+    {
+        _params_decoded = true;
+        std::string_view query = view(_query);
+        while (!query.empty())
+        {
+            size_t amp = query.find('&');
+            std::string_view param = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+            size_t eq = param.find('=');
+            if (eq == 0 || eq == std::string_view::npos || eq + 1 == param.size())
+            {
+                continue;
+            }
+            _query_params.emplace_back();
+            Util::urlDecode(param.substr(0, eq), _query_params.back().first, true);
+            Util::urlDecode(param.substr(eq + 1), _query_params.back().second, true);
+        }
+    }
 
 public:
-    // 重置请求信息
+    // 重置请求信息（保留各容器的空间，供同一连接上的下一个请求复用）
     void reset()
     {
-        _method.clear();
-        _url.clear();
-        _version.clear();
-        _body.clear();
+        _head.clear();
+        _method = std::string_view();
+        _path = _query = _version = Span();
         _headers.clear();
+        _trailers.clear();
+        _body.clear();
+        _path_decoded = false;
+        _resource_path.clear();
+        _params_decoded = false;
         _query_params.clear();
 
         std::smatch sm;
         _matches.swap(sm);
     }
 
-    // 设置头部字段
-    void setHeader(const std::string &key, const std::string &val)
+    // 请求方法（大写）
+    std::string_view method() const
     {
-        if (key.empty() || val.empty())
-        {
-            return;
-        }
-        _headers[key] = val;
+        return _method;
     }
-    // 获取头部字段
-    std::string getHeader(const std::string &key) const
+    // 解码后的资源路径
+    const std::string &path() const
     {
-        auto it = _headers.find(key);
-        if(it == _headers.end())
+        if (!_path_decoded)
         {
-            return "";
+            _path_decoded = true;
+            Util::urlDecode(view(_path), _resource_path);
         }
-        return it->second;
+        return _resource_path;
+    }
+    // 未解码的查询字符串
+    std::string_view query() const
+    {
+        return view(_query);
+    }
+    // HTTP版本，如"HTTP/1.1"
+    std::string_view version() const
+    {
+        return view(_version);
+    }
 
-        // return hasHeader(key) ? _headers[key] : "";
+    // 获取头部字段（名字忽略大小写），不存在时返回空
+    std::string_view header(std::string_view key) const
+    {
+        const HeaderSpan *h = findHeader(key);
+        return h ? view(h->value) : std::string_view();
+    }
+    std::string getHeader(const std::string &key) const
+    {
+        return std::string(header(key));
     }
     // 查看头部字段是否存在
-    bool hasHeader(const std::string &key) const
+    bool hasHeader(std::string_view key) const
     {
-        return _headers.find(key) != _headers.end();
+        return findHeader(key) != nullptr;
+    }
+    // 遍历所有头部字段 fn(name, value)
+    template <class Fn>
+    void forEachHeader(Fn fn) const
+    {
+        for (auto &h : _headers)
+        {
+            fn(view(h.name), view(h.value));
+        }
     }
 
-    // 设置查询字符串参数
-    void setParam(const std::string &key, const std::string &val)
+    // 获取尾部字段（分块传输的请求体之后发送的字段，名字忽略大小写），不存在时返回空
+    std::string_view trailer(std::string_view key) const
     {
-        if (key.empty() || val.empty())
+        const HeaderSpan *h = findField(_trailers, key);
+        return h ? view(h->value) : std::string_view();
+    }
+    // 遍历所有尾部字段 fn(name, value)
+    template <class Fn>
+    void forEachTrailer(Fn fn) const
+    {
+        for (auto &h : _trailers)
         {
-            return;
+            fn(view(h.name), view(h.value));
         }
-        _query_params[key] = val;
     }
-    // 获取查询字符串参数
+
+    // 请求体是否分块传输（Transfer-Encoding: chunked）
+    bool chunked() const
+    {
+        return Util::equalsIgnoreCase(header("Transfer-Encoding"), "chunked");
+    }
+
+    // 获取查询字符串参数（解码后）
     std::string getParam(const std::string &key) const
     {
-        auto it = _query_params.find(key);
-        if(it == _query_params.end())
+        if (!_params_decoded)
         {
-            return "";
+            decodeParams();
         }
-        return it->second;
-
-        // return hasParam(key) ? _query_params[key] : "";
+        for (auto &kv : _query_params)
+        {
+            if (kv.first == key)
+            {
+                return kv.second;
+            }
+        }
+        return "";
     }
     // 查看查询字符串参数是否存在
     bool hasParam(const std::string &key) const
     {
-        return _query_params.find(key) != _query_params.end();
+        if (!_params_decoded)
+        {
+            decodeParams();
+        }
+        for (auto &kv : _query_params)
+        {
+            if (kv.first == key)
+            {
+                return true;
+            }
+        }
+        return false;
     }
 
-    // 获取请求体长度
-    size_t getContentLength()
+    // 解析Content-Length，没有该字段时为0，格式不正确返回false
+    // 有多个Content-Length字段时值必须相同，否则前后的代理可能按不同的长度划分请求（请求走私），返回false
+    bool contentLength(uint64_t *len) const
     {
-        if (hasHeader("Content-Length"))
+        *len = 0;
+        bool found = false;
+        for (auto &h : _headers)
         {
-            return std::stol(getHeader("Content-Length"));
+            if (!Util::equalsIgnoreCase(view(h.name), "Content-Length"))
+            {
+                continue;
+            }
+            uint64_t val = 0;
+            if (!parseLength(view(h.value), &val) || (found && val != *len))
+            {
+                return false;
+            }
+            *len = val;
+            found = true;
         }
-        return 0;
+        return true;
+    }
+    // 解析十进制的长度值（只允许数字，最多18位，不会溢出）
+    static bool parseLength(std::string_view val, uint64_t *len)
+    {
+        *len = 0;
+        if (val.empty() || val.size() > 18)
+        {
+            return false;
+        }
+        for (char c : val)
+        {
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            *len = *len * 10 + (c - '0');
+        }
+        return true;
+    }
+    // 获取请求体长度
+    size_t getContentLength() const
+    {
+        uint64_t len = 0;
+        contentLength(&len);
+        return len;
     }
 
     // 判断是否为短连接
     bool close() const
     {
-        return !hasHeader("Connection") || getHeader("Connection") == "close";
+        std::string_view conn = header("Connection");
+        return conn.empty() || Util::equalsIgnoreCase(conn, "close");
     }
 
-    void printRequestInfo()
+    void printRequestInfo() const
     {
         std::cout << "====== HTTP Request Debug Info ======" << std::endl;
-        std::cout << "Method: " << _method << std::endl;
-        std::cout << "URL: " << _url << std::endl;
-        std::cout << "Resource Path: " << _resource_path << std::endl;
-        std::cout << "HTTP Version: " << _version << std::endl;
+        std::cout << "Method: " << method() << std::endl;
+        std::cout << "Resource Path: " << path() << std::endl;
+        std::cout << "HTTP Version: " << version() << std::endl;
 
         std::cout << "Headers: " << std::endl;
-        for (const auto &header : _headers)
-        {
-            std::cout << "  " << header.first << ": " << header.second << std::endl;
-        }
+        forEachHeader([](std::string_view name, std::string_view value) {
+            std::cout << "  " << name << ": " << value << std::endl;
+        });
 
         std::cout << "Query Parameters: " << std::endl;
+        if (!_params_decoded)
+        {
+            decodeParams();
+        }
         for (const auto &param : _query_params)
         {
             std::cout << "  " << param.first << ": " << param.second << std::endl;
@@ -537,6 +731,7 @@ public:
     int _stat_code;                                        // 状态码
     std::unordered_map<std::string, std::string> _headers; // 响应头
     std::string _body;                                     // 响应体
+    OutputQueue::FilePtr _file_body;                       // 文件响应体（设置后忽略_body，用sendfile发送）
     bool _redirect_flag;                                   // 是否重定向
     std::string _redirect_url;                             // 重定向路径（如果有）
 
@@ -549,6 +744,7 @@ public:
         _stat_code = 0;
         _headers.clear();
         _body.clear();
+        _file_body.reset();
         _redirect_flag = false;
         _redirect_url.clear();
     }
@@ -580,6 +776,20 @@ public:
         _body = body;
     }
 
+    // 设置文件响应体（文件内容不读入内存，由连接用sendfile直接发送）
+    void setFileBody(const OutputQueue::FilePtr &file, const std::string &type)
+    {
+        setHeader("Content-Type", type);
+        _body.clear();
+        _file_body = file;
+    }
+
+    // 获取响应体长度
+    size_t bodyLength() const
+    {
+        return _file_body ? _file_body->size() : _body.size();
+    }
+
     // 设置重定向（设置重定向状态码和重定向路径）
     void setRedirect(const std::string &redirect_url, int stat_code = 302)
     {
@@ -595,23 +805,31 @@ public:
         return !hasHeader("Connection") || getHeader("Connection") == "close";
     }
 
-    // 序列化
-    std::string serialize()
+    // 序列化首行和报头（包括空行）
+    std::string serializeHead()
     {
-        std::ostringstream ss;
+        std::string head;
+        head.reserve(256);
         //首行
-        ss << _version << " " << _stat_code << " " << Util::getStatusDesc(_stat_code) << "\r\n";
+        head.append(_version).append(" ").append(std::to_string(_stat_code)).append(" ");
+        head.append(Util::getStatusDesc(_stat_code)).append("\r\n");
         //报头
         for(auto& [k, v] : _headers)
         {
-            ss << k << ": " << v << "\r\n";
+            head.append(k).append(": ").append(v).append("\r\n");
         }
         //空行
-        ss << "\r\n";
-        //正文
-        ss << _body;
+        head.append("\r\n");
+        return head;
+    }
 
-        return ss.str();
+    // 序列化（文件响应体不在其中，需要单独发送）
+    std::string serialize()
+    {
+        std::string str = serializeHead();
+        //正文
+        str.append(_body);
+        return str;
     }
 
 }; // HttpResponse
@@ -626,14 +844,70 @@ typedef enum
     PARSE_FINISHED,     // 解析完成
 } HttpParseStat;
 
-#define MAX_BODY_LEN (5 * 1024 * 1024 * 1024)
+#define MAX_BODY_LEN (5 * 1024 * 1024 * 1024ULL)
+// 请求首部用状态机逐字节解析，直接在Buffer的数据上进行，不拷贝行、不拆分字符串
+// 数据不完整时记下状态和扫描位置（相对于Buffer读位置的偏移），新数据到来后从断点继续，已扫描过的字节不再重复扫描
+// 整个首部到齐后才拷贝到请求对象中、从Buffer中取走，此前记录的各段偏移就是在_head中的偏移
+// 请求体按Content-Length或者分块传输（Transfer-Encoding: chunked）接收，数据从Buffer直接交给appendBody
 class HttpContext
 {
-    const static size_t MAX_LINE_LEN = 8192; // 8KB
+public:
+    // 请求体数据到达时的回调（每到达一段调用一次）
+    using BodyCallback = std::function<void(const char *data, size_t len)>;
+
+private:
+    const static size_t MAX_LINE_LEN = 8192;      // 8KB
+    const static size_t MAX_HEAD_LEN = 64 * 1024; // 请求首部的最大长度
+    const static size_t MAX_HEADERS = 100;        // 请求头的最大个数
+    const static size_t MAX_METHOD_LEN = 7;       // 最长的请求方法（OPTIONS）
+    const static size_t VERSION_LEN = 8;          // "HTTP/x.y"
+
+    const static size_t MAX_CHUNK_LINE_LEN = 1024;           // 块大小行（包括块扩展）的最大长度
+    const static uint64_t MAX_CHUNK_LEN = 64 * 1024 * 1024; // 单个块的最大长度
+
+    // 请求首部解析状态
+    typedef enum
+    {
+        HEAD_METHOD,      // 请求方法
+        HEAD_PATH,        // 资源路径
+        HEAD_QUERY,       // 查询字符串
+        HEAD_VERSION,     // 协议版本
+        HEAD_LINE_LF,     // 请求行末尾的'\n'
+        HEAD_LINE_START,  // 一行头部的开头（或结束首部的空行）
+        HEAD_NAME,        // 头部字段名
+        HEAD_VALUE_START, // 字段值前的空白
+        HEAD_VALUE,       // 字段值
+        HEAD_VALUE_LF,    // 头部行末尾的'\n'
+        HEAD_END_LF,      // 空行的'\n'
+    } HeadState;
+
+    // 分块请求体的解码状态：块大小行、块数据、块数据后的"\r\n"，大小为0的块之后是尾部字段和结束的空行
+    typedef enum
+    {
+        CHUNK_SIZE,     // 块大小行（十六进制长度，可以带块扩展）
+        CHUNK_DATA,     // 块数据
+        CHUNK_DATA_END, // 块数据后的"\r\n"
+        CHUNK_TRAILER,  // 尾部字段行（或结束的空行）
+    } ChunkState;
+
 private:
     HttpRequest _request;      // 请求信息
     HttpParseStat _parse_stat; // 当前解析状态
     int _resp_stat_code;       // 响应状态码
+
+    HeadState _head_state = HEAD_METHOD; // 请求首部的解析状态
+    uint32_t _scan = 0;                  // 下一个要扫描的字节（相对于Buffer读位置的偏移）
+    uint32_t _token = 0;                 // 当前记号的起始偏移
+    uint32_t _line = 0;                  // 当前行的起始偏移
+    HttpRequest::Span _name;             // 正在解析的头部字段名
+
+    bool _chunked = false;                // 请求体是否分块传输
+    ChunkState _chunk_state = CHUNK_SIZE; // 分块请求体的解码状态
+    uint64_t _chunk_left = 0;             // 当前块还没有收到的数据长度
+    uint64_t _content_length = 0;         // Content-Length（不分块时）
+    uint64_t _body_len = 0;               // 已收到的请求体长度（不含分块格式）
+    BodyCallback _body_cb;                // 请求体数据的回调，设置后请求体不再存入HttpRequest::_body
+
 public:
     HttpContext() : _parse_stat(PARSE_REQUEST_LINE), _resp_stat_code(200) {}
 
@@ -650,6 +924,19 @@ public:
         return _request;
     }
 
+    // 设置请求体数据的回调（在请求体开始接收之前设置，上下文重置时清除）
+    void setBodyCallback(const BodyCallback &cb) { _body_cb = cb; }
+
+    // 只接收并解析请求首部：首部到齐后状态变为PARSE_BODY，调用方可以在接收请求体之前路由、设置请求体回调
+    bool recvAndParseHead(Buffer &buffer)
+    {
+        if (_parse_stat == PARSE_REQUEST_LINE || _parse_stat == PARSE_HEADERS)
+        {
+            recvHead(buffer);
+        }
+        return _parse_stat != PARSE_ERROR;
+    }
+
     // 接收并解析HTTP请求
     bool recvAndParseRequest(Buffer &buffer)
     {
@@ -660,229 +947,726 @@ public:
         switch (_parse_stat)
         {
         case PARSE_REQUEST_LINE:
-            recvRequestLine(buffer);
-                // DF_DEBUG("请求行解析成功");
         case PARSE_HEADERS:
-            recvHeaders(buffer);
-                // DF_DEBUG("请求报头解析成功");
+            recvHead(buffer);
+                // DF_DEBUG("请求首部解析成功");
         case PARSE_BODY:
             recvBody(buffer);
                 // DF_DEBUG("请求正文解析成功");
+        default:
+            break;
         }
         return _parse_stat != PARSE_ERROR;
     }
 
-    // 重置上下文信息
+    // 重置上下文信息，准备接收同一连接上的下一个请求
     void reset()
     {
         _parse_stat = PARSE_REQUEST_LINE;
         _resp_stat_code = 200;
+        _request.reset();
+        _head_state = HEAD_METHOD;
+        _scan = _token = _line = 0;
+        _chunked = false;
+        _chunk_state = CHUNK_SIZE;
+        _chunk_left = _content_length = _body_len = 0;
+        _body_cb = nullptr;
     }
 
 private:
-    bool recvRequestLine(Buffer &buffer)
+    bool fail(int stat_code)
     {
-        if (_parse_stat != PARSE_REQUEST_LINE)
-        {
-            return false;
-        }
-        // 1.读取buffer中的一行数据
-        std::string line = buffer.getLine("\r\n");
-        if (line.size() == 0)//找不到换行符
+        _parse_stat = PARSE_ERROR;
+        _resp_stat_code = stat_code;
+        return false;
+    }
+
+    // 字符分类表：首部中的每个字节查一次表，判断能否出现在当前记号中
+    // 字段值（控制字符以外的字符和制表符）不查表，由ByteScan::findCtl成块判断
+    enum : uint8_t
+    {
+        CHAR_TOKEN = 1, // 方法名、字段名：RFC 9110 token（字母、数字和 !#$%&'*+-.^_`|~）
+        CHAR_PATH = 2,  // 资源路径：除空格、'?'和控制字符以外的字符
+        CHAR_QUERY = 4, // 查询字符串：除空格和控制字符以外的字符
+    };
+    struct CharTable
+    {
+        uint8_t cls[256];
+        constexpr CharTable() : cls()
         {
-            // 缓冲区数据不足一行，且长度过长，设置状态码
-            if (buffer.readableBytes() > MAX_LINE_LEN)
+            for (int c = 0; c < 256; c++)
             {
-                _parse_stat = PARSE_ERROR;
-                _resp_stat_code = 414; // URI TOO LONG
-                return false;
+                bool ctl = c < 0x20 || c == 0x7f;
+                bool alnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+                bool tchar = false;
+                for (const char *s = "!#$%&'*+-.^_`|~"; *s; s++)
+                {
+                    tchar = tchar || c == *s;
+                }
+                cls[c] = (alnum || tchar ? CHAR_TOKEN : 0) | (!ctl && c != ' ' && c != '?' ? CHAR_PATH : 0) |
+                         (!ctl && c != ' ' ? CHAR_QUERY : 0);
             }
-            // 缓冲区数据不足一行，且长度较短，返回等待新数据到来，凑到一行再来处理
-            return true;
         }
-        // 从buffer中读到一个完整的请求行
-        if (line.size() > MAX_LINE_LEN)
+    };
+    static uint8_t charClass(char c)
+    {
+        static constexpr CharTable table;
+        return table.cls[(uint8_t)c];
+    }
+
+    // 从i开始跳过属于cls类的字符，返回第一个不属于的位置（到n为止）
+    static size_t skip(const char *p, size_t i, size_t n, uint8_t cls)
+    {
+        while (i < n && (charClass(p[i]) & cls))
         {
-            // 请求行过长
-            _parse_stat = PARSE_ERROR;
-            _resp_stat_code = 414; // URI TOO LONG
-            return false;
+            i++;
         }
-        // 2.去除line中的换行符，方便正则表达式匹配
-        line.erase(line.size() - strlen("\r\n"));
+        return i;
+    }
 
-        // 2.解析请求行
-        bool ret = parseRequestLine(line);
-        if(ret == true)
+    // 识别请求方法（忽略大小写），记录为静态的大写字符串
+    bool setMethod(std::string_view token)
+    {
+        static const std::string_view methods[] = {"GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS", "PATCH"};
+        for (auto m : methods)
         {
-            _parse_stat = PARSE_HEADERS;// 当前解析成功完成，更改为下一个解析状态
-            return true;
+            if (Util::equalsIgnoreCase(token, m))
+            {
+                _request._method = m;
+                return true;
+            }
         }
         return false;
     }
 
-    bool parseRequestLine(const std::string &line)
+    // 协议版本必须是"HTTP/数字.数字"（忽略大小写）
+    static bool isVersion(const char *p)
     {
-        // 1.使用正则表达式解析，捕获关键要素（忽略大小写）
-        static const std::regex http_reg(R"((GET|POST|PUT|DELETE|HEAD|OPTIONS|PATCH) ([^ ?]+)(?:\?([^ ]*))? HTTP\/(\d\.\d)$)", std::regex::icase);
-        std::smatch matches;
-        bool ok = std::regex_match(line, matches, http_reg);
-        if (!ok)
-        {
-            _parse_stat = PARSE_ERROR;
-            _resp_stat_code = 400; // Bad Request
-            return false;
-        }
+        return strncasecmp(p, "HTTP/", 5) == 0 && isdigit((unsigned char)p[5]) && p[6] == '.' && isdigit((unsigned char)p[7]);
+    }
 
-        // 2.matches[0]是整个请求行，往后是各项匹配结果
-        // 设置httpRequest各项元素，资源路径和查询字符串参数可能会有特殊字符，需要解码
-        // 请求方法 （请求方法小写转大写）
-        std::string method = matches[1];
-        std::transform(method.begin(), method.end(), method.begin(), ::toupper);
-        _request._method = method;
-        _request._resource_path = Util::urlDecode(matches[2]); // 资源路径
-        _request._url = _request._resource_path;               // URL
-        if (matches[3].matched)                                // 查询字符串（如果有）
-        {
-            std::vector<std::string> params;
-            Util::split(matches[3].str(), "&", params);
-            std::vector<std::string> kv;
-            for (auto &param : params)
+    // 解析请求首部：从上次停下的位置继续扫描Buffer中的数据，首部完整时拷贝到请求对象中
+    // 每个状态先连续跳过当前记号中的字符，再处理结束它的分隔符；数据用完时停在记号中间，下次从这里继续
+    bool recvHead(Buffer &buffer)
+    {
+        const char *p = (const char *)buffer.readPos();
+        size_t n = std::min(buffer.readableBytes(), (size_t)MAX_HEAD_LEN);
+        size_t i = _scan;
+        while (i < n)
+        {
+            switch (_head_state)
             {
-                kv.clear();
-                size_t ret = Util::split(param, "=", kv);
-                if (ret != 2)
+            case HEAD_METHOD:
+                i = skip(p, i, n, CHAR_TOKEN);
+                if (i == n)
                 {
-                    _parse_stat = PARSE_ERROR;
-                    _resp_stat_code = 400; // Bad Request
-                    return false;
+                    break;
+                }
+                if (p[i] != ' ' || !setMethod(std::string_view(p + _token, i - _token)))
+                {
+                    return fail(400); // Bad Request
+                }
+                _token = ++i;
+                _head_state = HEAD_PATH;
+                break;
+            case HEAD_PATH:
+                i = skip(p, i, n, CHAR_PATH);
+                if (i == n)
+                {
+                    break;
+                }
+                if ((p[i] != ' ' && p[i] != '?') || i == _token)
+                {
+                    return fail(400);
+                }
+                _request._path = {_token, (uint32_t)i - _token};
+                _head_state = p[i] == ' ' ? HEAD_VERSION : HEAD_QUERY;
+                _token = ++i;
+                break;
+            case HEAD_QUERY:
+                i = skip(p, i, n, CHAR_QUERY);
+                if (i == n)
+                {
+                    break;
+                }
+                if (p[i] != ' ')
+                {
+                    return fail(400);
+                }
+                _request._query = {_token, (uint32_t)i - _token};
+                _head_state = HEAD_VERSION;
+                _token = ++i;
+                break;
+            case HEAD_VERSION:
+                while (i < n && p[i] != '\r' && i - _token < VERSION_LEN)
+                {
+                    i++;
+                }
+                if (i == n)
+                {
+                    break;
+                }
+                if (p[i] != '\r' || i - _token != VERSION_LEN || !isVersion(p + _token))
+                {
+                    return fail(400);
+                }
+                _request._version = {_token, (uint32_t)VERSION_LEN};
+                _head_state = HEAD_LINE_LF;
+                i++;
+                break;
+            case HEAD_LINE_LF:
+                if (p[i] != '\n')
+                {
+                    return fail(400);
+                }
+                if (i - _line > MAX_LINE_LEN)
+                {
+                    return fail(414); // URI TOO LONG
+                }
+                _parse_stat = PARSE_HEADERS;
+                _line = ++i;
+                _head_state = HEAD_LINE_START;
+                break;
+            case HEAD_LINE_START:
+                if (p[i] == '\r')
+                {
+                    _head_state = HEAD_END_LF;
+                    i++;
+                    break;
+                }
+                if (!(charClass(p[i]) & CHAR_TOKEN))
+                {
+                    return fail(400);
+                }
+                _token = i;
+                _head_state = HEAD_NAME;
+                break;
+            case HEAD_NAME:
+                i = skip(p, i, n, CHAR_TOKEN);
+                if (i == n)
+                {
+                    break;
+                }
+                if (p[i] != ':')
+                {
+                    return fail(400);
+                }
+                _name = {_token, (uint32_t)i - _token};
+                _head_state = HEAD_VALUE_START;
+                i++;
+                break;
+            case HEAD_VALUE_START:
+                while (i < n && (p[i] == ' ' || p[i] == '\t'))
+                {
+                    i++;
+                }
+                if (i == n)
+                {
+                    break;
+                }
+                _token = i;
+                _head_state = HEAD_VALUE;
+                break;
+            case HEAD_VALUE:
+            {
+                // 字段值（Cookie、Authorization等）往往很长，用ByteScan成块查找结束的'\r'或非法的控制字符
+                i += ByteScan::findCtl(p + i, n - i);
+                if (i == n)
+                {
+                    break;
+                }
+                if (p[i] != '\r')
+                {
+                    return fail(400);
+                }
+                if (_request._headers.size() >= MAX_HEADERS)
+                {
+                    return fail(431); // Request Header Fields Too Large
+                }
+                // 去掉字段值末尾的空白
+                size_t end = i;
+                while (end > _token && (p[end - 1] == ' ' || p[end - 1] == '\t'))
+                {
+                    end--;
                 }
-                std::string key = Util::urlDecode(kv[0], true); // 解码，'+' -> ' '
-                std::string val = Util::urlDecode(kv[1], true);
-                _request.setParam(key, val);
+                _request._headers.push_back({_name, {_token, (uint32_t)end - _token}});
+                _head_state = HEAD_VALUE_LF;
+                i++;
+                break;
             }
+            case HEAD_VALUE_LF:
+                if (p[i] != '\n')
+                {
+                    return fail(400);
+                }
+                if (i - _line > MAX_LINE_LEN)
+                {
+                    return fail(431);
+                }
+                _line = ++i;
+                _head_state = HEAD_LINE_START;
+                break;
+            case HEAD_END_LF:
+                if (p[i] != '\n')
+                {
+                    return fail(400);
+                }
+                return finishHead(buffer, i + 1);
+            }
+        }
+        _scan = i;
+        // 首部还不完整：一行过长、或者整个首部过长时报错，否则等待新数据到来
+        if (_scan - _line > MAX_LINE_LEN)
+        {
+            return fail(_parse_stat == PARSE_REQUEST_LINE ? 414 : 431);
+        }
+        if (_scan >= MAX_HEAD_LEN)
+        {
+            return fail(431);
         }
-        _request._version = matches[4]; // 协议版本
-        _request._version = "HTTP/" + _request._version;
         return true;
     }
 
-    bool recvHeaders(Buffer &buffer)
+    // 请求首部完整：原文拷贝到请求对象中（各段偏移随之有效），从Buffer中取走
+    bool finishHead(Buffer &buffer, size_t head_len)
+    {
+        _request._head.assign((const char *)buffer.readPos(), head_len);
+        buffer.moveReadIdx(head_len);
+        // 版本统一为大写的"HTTP/x.y"
+        memcpy(&_request._head[_request._version.off], "HTTP", 4);
+        if (!_request.contentLength(&_content_length))
+        {
+            return fail(400);
+        }
+        if (_request.hasHeader("Transfer-Encoding"))
+        {
+            // 只支持chunked；同时带Content-Length时前后的代理可能按不同的长度划分请求（请求走私），直接拒绝
+            if (!_request.chunked())
+            {
+                return fail(501); // Not Implemented
+            }
+            if (_request.hasHeader("Content-Length"))
+            {
+                return fail(400);
+            }
+            _chunked = true;
+        }
+        else if (_content_length > MAX_BODY_LEN)
+        {
+            return fail(413); // Payload Too Large
+        }
+        _scan = 0;
+        _parse_stat = PARSE_BODY;
+        return true;
+    }
+
+    // 收到一段请求体数据：交给回调，或者存入请求对象
+    void appendBody(const char *data, size_t len)
+    {
+        _body_len += len;
+        if (_body_cb)
+        {
+            _body_cb(data, len);
+        }
+        else
+        {
+            _request._body.append(data, len);
+        }
+    }
+
+    bool recvBody(Buffer &buffer)
     {
-        if (_parse_stat != PARSE_HEADERS)
+        if (_parse_stat != PARSE_BODY)
         {
             return false;
         }
-        // 1.逐行获取数据
-        while (true)
+        if (_chunked)
+        {
+            return recvChunked(buffer);
+        }
+        // 按Content-Length读取：有多少取多少，不足时等待新数据到来
+        size_t len = std::min((uint64_t)buffer.readableBytes(), _content_length - _body_len);
+        appendBody((const char *)buffer.readPos(), len);
+        buffer.moveReadIdx(len);
+        if (_body_len == _content_length)
         {
-            std::string line = buffer.getLine("\r\n");
-            if (line.size() == 0) // 没有换行符，不构成一行数据
+            _parse_stat = PARSE_FINISHED;
+        }
+        return true;
+    }
+
+    // 分块传输的请求体：块数据直接从Buffer交给appendBody，不拷贝、不拼接
+    // 块大小行和尾部字段行找到完整的一行才处理，_scan记下已经扫描过的位置，新数据到来后从断点继续查找行尾
+    bool recvChunked(Buffer &buffer)
+    {
+        while (_parse_stat == PARSE_BODY)
+        {
+            const char *p = (const char *)buffer.readPos();
+            size_t n = buffer.readableBytes();
+            if (_chunk_state == CHUNK_DATA)
             {
-                if (buffer.readableBytes() > MAX_LINE_LEN)
+                size_t len = std::min((uint64_t)n, _chunk_left);
+                if (len == 0)
                 {
-                    _parse_stat = PARSE_ERROR;
-                    _resp_stat_code = 414; // URI TOO LONG
-                    return false;
+                    return true;
+                }
+                appendBody(p, len);
+                buffer.moveReadIdx(len);
+                _chunk_left -= len;
+                if (_chunk_left == 0)
+                {
+                    _chunk_state = CHUNK_DATA_END;
+                }
+                continue;
+            }
+            size_t end = _scan + ByteScan::findCRLF(p + _scan, n - _scan);
+            if (end == n)
+            {
+                // 行还不完整，最后一个字节是'\r'时下次从它开始
+                if (_chunk_state == CHUNK_TRAILER ? n > MAX_LINE_LEN : n > MAX_CHUNK_LINE_LEN)
+                {
+                    return fail(_chunk_state == CHUNK_TRAILER ? 431 : 400);
                 }
+                _scan = n > 0 && p[n - 1] == '\r' ? n - 1 : n;
                 return true;
             }
-            if (line.size() > MAX_LINE_LEN)
+            std::string_view line(p, end);
+            bool ok = _chunk_state == CHUNK_SIZE ? chunkSize(line) : _chunk_state == CHUNK_DATA_END ? chunkDataEnd(line) : chunkTrailer(line);
+            if (!ok)
             {
-                _parse_stat = PARSE_ERROR;
-                _resp_stat_code = 414; // URI TOO LONG
                 return false;
             }
-            if (line == "\r\n")
+            buffer.moveReadIdx(end + 2);
+            _scan = 0;
+        }
+        return _parse_stat != PARSE_ERROR;
+    }
+
+    // 块大小行：十六进制长度，后面可以有空白和以';'开始的块扩展（忽略）
+    bool chunkSize(std::string_view line)
+    {
+        if (line.size() > MAX_CHUNK_LINE_LEN)
+        {
+            return fail(400);
+        }
+        uint64_t size = 0;
+        size_t i = 0;
+        for (; i < line.size() && Util::hexValue(line[i]) >= 0; i++)
+        {
+            if (i == 15)
             {
-                // 读到空行，代表header处理结束
-                break;
+                return fail(413); // 长度超过60位
             }
-            // 去除行末换行符
-            line.erase(line.size() - strlen("\r\n"));
-            // 2.解析一个请求头部
-            if (parseHeaders(line) == false)
+            size = size * 16 + Util::hexValue(line[i]);
+        }
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t'))
+        {
+            i++;
+        }
+        if (i == 0 || (i < line.size() && line[i] != ';'))
+        {
+            return fail(400);
+        }
+        if (size > MAX_CHUNK_LEN || size > MAX_BODY_LEN - _body_len)
+        {
+            return fail(413);
+        }
+        _chunk_left = size;
+        _chunk_state = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+        return true;
+    }
+
+    // 块数据后面必须紧跟"\r\n"
+    bool chunkDataEnd(std::string_view line)
+    {
+        if (!line.empty())
+        {
+            return fail(400);
+        }
+        _chunk_state = CHUNK_SIZE;
+        return true;
+    }
+
+    // 尾部字段行"name: value"，原文追加到_head末尾，记录偏移；空行表示请求结束
+    bool chunkTrailer(std::string_view line)
+    {
+        if (line.empty())
+        {
+            _parse_stat = PARSE_FINISHED;
+            return true;
+        }
+        if (line.size() > MAX_LINE_LEN || _request._trailers.size() >= MAX_HEADERS)
+        {
+            return fail(431);
+        }
+        size_t colon = 0;
+        while (colon < line.size() && (charClass(line[colon]) & CHAR_TOKEN))
+        {
+            colon++;
+        }
+        if (colon == 0 || colon == line.size() || line[colon] != ':')
+        {
+            return fail(400);
+        }
+        size_t begin = colon + 1;
+        while (begin < line.size() && (line[begin] == ' ' || line[begin] == '\t'))
+        {
+            begin++;
+        }
+        if (begin + ByteScan::findCtl(line.data() + begin, line.size() - begin) != line.size())
+        {
+            return fail(400);
+        }
+        size_t end = line.size();
+        while (end > begin && (line[end - 1] == ' ' || line[end - 1] == '\t'))
+        {
+            end--;
+        }
+        uint32_t off = _request._head.size();
+        _request._head.append(line.data(), line.size());
+        _request._trailers.push_back({{off, (uint32_t)colon}, {off + (uint32_t)begin, (uint32_t)(end - begin)}});
+        return true;
+    }
+
+}; // HttpContext
+
+// 流式响应：处理函数先发送首部，再逐段发送响应体，最后调用end结束
+// 响应头中有Content-Length时按固定长度发送，否则分块传输（HTTP/1.0的客户端不支持分块，原样发送，结束后关闭连接）
+// 处理函数返回后仍可以继续发送（如在定时器中），end之前请求对象一直有效，同一连接上后面的请求等本响应结束后才处理
+// 各方法只能在连接所在的EventLoop线程中调用，其它线程通过runInLoop投递
+// 连接的输出队列处于高水位之上时writable()返回false，用onWritable等输出队列降到低水位后再继续写，响应体不在内存中堆积
+class ResponseWriter
+{
+public:
+    using Callback = std::function<void()>;
+    // 响应结束回调（由服务器设置，参数表示是否需要关闭连接）
+    using EndCallback = std::function<void(const PtrConnection &conn, bool close)>;
+
+private:
+    PtrConnection _conn;  // 所属连接
+    std::string _version; // 请求的协议版本
+    bool _head_request;   // 是否为HEAD请求（只发送首部）
+    bool _close;          // 响应结束后是否关闭连接
+    EndCallback _end_cb;  // 响应结束回调
+
+    bool _head_sent = false;      // 首部是否已发送
+    bool _chunked = false;        // 是否分块传输
+    bool _fixed_length = false;   // 是否按Content-Length发送
+    bool _ended = false;          // 是否已结束
+    uint64_t _content_length = 0; // Content-Length
+    uint64_t _body_sent = 0;      // 已发送的响应体长度
+    Callback _writable_cb;        // 等待可写的回调
+
+public:
+    ResponseWriter(const PtrConnection &conn, const HttpRequest &request, bool close, const EndCallback &end_cb)
+        : _conn(conn), _version(request.version().empty() ? "HTTP/1.1" : request.version()),
+          _head_request(request.method() == "HEAD"), _close(close), _end_cb(end_cb)
+    {
+    }
+
+    // 发送响应首部（状态码和头部取自response，响应体部分被忽略），Content-Length格式不正确时返回false
+    bool writeHead(HttpResponse &response)
+    {
+        _conn->loop()->assertInLoop();
+        if (_head_sent || _ended)
+        {
+            return false;
+        }
+        if (response.hasHeader("Content-Length"))
+        {
+            if (!HttpRequest::parseLength(response.getHeader("Content-Length"), &_content_length))
             {
+                DF_ERROR("响应头中的Content-Length格式不正确: %s", response.getHeader("Content-Length").c_str());
                 return false;
             }
+            _fixed_length = true;
         }
-
-        _parse_stat = PARSE_BODY; // 当前解析成功完成，更改为下一个解析状态
+        else if (_version == "HTTP/1.1")
+        {
+            _chunked = true;
+            response.setHeader("Transfer-Encoding", "chunked");
+        }
+        else
+        {
+            // 没有长度也不能分块，以关闭连接表示响应结束
+            _close = true;
+        }
+        _head_sent = true;
+        response.setHeader("Connection", _close ? "close" : "keep-alive");
+        response._version = _version;
+        _conn->send(response.serializeHead());
         return true;
     }
 
-    bool parseHeaders(const std::string &line)
+    // 发送一段响应体，连接已关闭、超出Content-Length时返回false
+    bool write(const char *data, size_t len)
     {
-        // Content-Length: 50
-        std::vector<std::string> kv;
-        size_t ret = Util::split(line, ": ", kv);
-        if (ret != 2)
+        return write(std::string(data, len));
+    }
+    bool write(std::string &&data)
+    {
+        _conn->loop()->assertInLoop();
+        if (!_head_sent || _ended || !_conn->isConnected())
         {
-            _parse_stat = PARSE_ERROR;
-            _resp_stat_code = 400; // Bad Request
-            DF_ERROR("parseHeaders fail: %s", line.c_str());
             return false;
         }
-        std::string key = kv[0];
-        std::string val = kv[1];
-        _request.setHeader(key, val);
-
+        if (_fixed_length && data.size() > _content_length - _body_sent)
+        {
+            return false;
+        }
+        // 长度为0的块表示响应结束，空数据不发送
+        if (data.empty() || _head_request)
+        {
+            return true;
+        }
+        _body_sent += data.size();
+        if (!_chunked)
+        {
+            _conn->send(std::move(data));
+            return true;
+        }
+        char size_line[24];
+        int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", data.size());
+        std::string chunk;
+        chunk.reserve(n + data.size() + 2);
+        chunk.append(size_line, n).append(data).append("\r\n");
+        _conn->send(std::move(chunk));
         return true;
     }
 
-    bool recvBody(Buffer &buffer)
+    // 结束响应：分块传输时发送结束块，之后服务器继续处理同一连接上的后续请求（或关闭连接）
+    bool end()
     {
-        if (_parse_stat != PARSE_BODY)
+        _conn->loop()->assertInLoop();
+        if (!_head_sent || _ended)
         {
             return false;
         }
-        // 1.获取请求的正文长度
-        size_t content_length = _request.getContentLength();
+        _ended = true;
+        _writable_cb = nullptr;
+        bool close = _close;
+        if (_fixed_length && _body_sent != _content_length && !_head_request)
+        {
+            // 发送的长度与Content-Length不符，连接上后面的数据无法划分，只能关闭
+            DF_WARN("响应体长度%" PRIu64 "与Content-Length %" PRIu64 "不符, 关闭连接", _body_sent, _content_length);
+            close = true;
+        }
+        if (_chunked && !_head_request)
+        {
+            _conn->send("0\r\n\r\n", 5);
+        }
+        EndCallback end_cb = std::move(_end_cb);
+        _end_cb = nullptr;
+        end_cb(_conn, close);
+        return true;
+    }
 
-        if (content_length == 0)
+    // 连接的输出队列是否不在高水位之上（连接已关闭时也返回true，随后的write返回false）
+    bool writable() const
+    {
+        if (!_conn->isConnected())
         {
-            // 没有正文
-            _parse_stat = PARSE_FINISHED;
             return true;
         }
-        if ((uint64_t)content_length > MAX_BODY_LEN)
+        return !_conn->isAboveHighWaterMark();
+    }
+    // 可写时调用cb一次：现在就可写时放入任务队列，否则等输出队列降到低水位（或连接关闭）
+    void onWritable(const Callback &cb)
+    {
+        _conn->loop()->assertInLoop();
+        if (_ended)
         {
-            // 请求正文过大
-            _parse_stat = PARSE_ERROR;
-            _resp_stat_code = 413; // Payload Too Large
-            return false;
+            return;
         }
-
-        // 2.获取当前已读取的正文长度，判断还差多少
-        size_t diff_len = content_length - _request._body.size();
-
-        // 3.读取正文数据
-        if (buffer.readableBytes() < diff_len)
+        if (writable())
         {
-            // 不足diff_len，有多少取多少，等待下次新数据到来
-            _request._body.append(buffer.readPos(), buffer.readableBytes());
-            buffer.moveReadIdx(buffer.readableBytes());
+            _conn->loop()->cacheTask(cb);
+            return;
         }
-        else
+        _writable_cb = cb;
+    }
+    // 由服务器在输出队列降到低水位、连接关闭时调用
+    void notifyWritable()
+    {
+        if (_writable_cb)
         {
-            // 足够，则读取diff_len
-            _request._body.append(buffer.readPos(), diff_len);
-            buffer.moveReadIdx(diff_len);
-            // 读取正文结束
-            _parse_stat = PARSE_FINISHED;
+            Callback cb = std::move(_writable_cb);
+            _writable_cb = nullptr;
+            cb();
         }
+    }
 
-        return true;
+    // 在连接所在的EventLoop线程中执行（其它线程中生成响应体时使用）
+    void runInLoop(const Callback &cb)
+    {
+        _conn->loop()->runInLoop(cb);
+    }
+    bool ended() const
+    {
+        return _ended;
+    }
+    const PtrConnection &connection() const
+    {
+        return _conn;
     }
 
-}; // HttpContext
+}; // ResponseWriter
+using PtrResponseWriter = std::shared_ptr<ResponseWriter>;
 
 //HTTP服务器
 class HttpServer
 {
     static const int DEFAULT_ACTIVE_TIMEOUT = 10;
+    static const size_t DEFAULT_HIGH_WATER = 1024 * 1024; // 连接输出队列默认的高水位
+    static const size_t DEFAULT_LOW_WATER = 256 * 1024;   // 连接输出队列默认的低水位
+
+public:
     using Handler = std::function<void(const HttpRequest &request, HttpResponse &response)>;
-    using HandlerMap = std::vector<std::pair<std::regex, Handler>>;
+    // 流式请求体的回调（每个请求一份，lambda中可以持有该请求自己的状态，如打开的文件）
+    // 请求体每到达一段调用一次onBodyChunk，数据不存入HttpRequest::_body；接收完毕后调用onBodyEnd生成响应
+    // 连接中途断开时不会调用onBodyEnd，回调随连接一起释放
+    struct BodyStream
+    {
+        HttpContext::BodyCallback onBodyChunk; // 请求体数据到达
+        Handler onBodyEnd;                     // 请求体接收完毕
+    };
+    // 流式路由的处理函数：请求首部到齐后调用，返回该请求的回调
+    using StreamHandler = std::function<BodyStream(const HttpRequest &request)>;
+    // 流式响应的处理函数：请求完整后调用，通过writer发送响应（见ResponseWriter）
+    using WriterHandler = std::function<void(const HttpRequest &request, const PtrResponseWriter &writer)>;
+
+private:
+    // 路由项：普通路由在请求完整后调用handler，流式路由（stream不为空）在首部到齐后调用stream
+    // 流式响应的路由（writer不为空）在请求完整后调用writer
+    struct Route
+    {
+        std::regex pattern;
+        Handler handler;
+        StreamHandler stream;
+        WriterHandler writer;
+    };
+    using HandlerMap = std::vector<Route>;
+
+    // 连接上下文：请求接收上下文，以及当前请求路由到的处理函数（首部到齐后路由，请求完整后调用）
+    struct HttpSession
+    {
+        HttpContext _context;          // 请求接收上下文
+        bool _routed = false;          // 当前请求是否已经路由
+        int _route_stat = 200;         // 路由失败时的状态码
+        Handler _handler;              // 处理函数（路由失败时为空）
+        WriterHandler _writer_handler; // 流式响应的处理函数
+        PtrResponseWriter _writer;     // 正在进行的流式响应（结束前不处理后面的请求）
+
+        // 重置，准备处理同一连接上的下一个请求
+        void reset()
+        {
+            _context.reset();
+            _routed = false;
+            _route_stat = 200;
+            _handler = nullptr;
+            _writer_handler = nullptr;
+        }
+    };
 
 private:
     TcpServer _server;         // 底层IO的tcp服务器
@@ -898,9 +1682,9 @@ private:
 
     void onConnected(const PtrConnection& conn)
     {
-        //将连接上下文设置为HttpContext
-        DF_DEBUG("New connection id: %d", conn->Id());
-        conn->setContext(HttpContext());
+        //将连接上下文设置为HttpSession
+        DF_DEBUG("New connection id: %" PRIu64, conn->Id());
+        conn->setContext(HttpSession());
     }
 
     // 读缓冲区数据到来，进行处理
@@ -911,16 +1695,35 @@ private:
     // 最后根据连接是否为长连接，判断是否关闭连接
     void onMessage(const PtrConnection & conn, Buffer & buffer)
     {
-        // DF_DEBUG("进入HTTP server onMessage, connection id: %d", conn->Id());
+        // DF_DEBUG("进入HTTP server onMessage, connection id: %" PRIu64, conn->Id());
         // DF_DEBUG("Buffer中的数据: %s", buffer.readPos());
 
         while(buffer.readableBytes() > 0) 
         {
             //1.获取连接的上下文信息
-            HttpContext* context = conn->getContext()->get<HttpContext>();
+            HttpSession* session = conn->getContext()->get<HttpSession>();
+            HttpContext* context = &session->_context;
+            if(session->_writer)
+            {
+                // 前一个请求的流式响应还没有结束，后面的请求等它结束后再处理
+                return;
+            }
 
-            //2.从缓冲区读取并解析一个请求
-            bool ok = context->recvAndParseRequest(buffer);
+            //2.从缓冲区读取并解析一个请求：首部到齐后先路由，流式路由的请求体边到达边交给处理函数
+            context->recvAndParseHead(buffer);
+            if(context->getParseStat() == PARSE_BODY && !session->_routed)
+            {
+                HttpResponse routed;
+                session->_handler = route(*session, routed);
+                session->_route_stat = routed._stat_code;
+                session->_routed = true;
+                if(!session->_handler && !session->_writer_handler)
+                {
+                    // 路由失败，请求体不会被处理，边到达边丢弃（不存入请求对象），收完后返回错误页面
+                    context->setBodyCallback([](const char *, size_t) {});
+                }
+            }
+            context->recvAndParseRequest(buffer);
             HttpResponse response(context->getRespStatCode());
             if(context->getParseStat() == PARSE_ERROR)
             {
@@ -931,7 +1734,7 @@ private:
                 // 返回响应给客户端（注意此时获取的request是无效的，但是由于后面连接就要关闭了，所以无所谓）
                 writeResponse(conn, context->getRequest(), response);
                 // 清空缓冲区，连接出错，数据是无效的，避免干扰关闭连接的操作(读缓冲区里如果还有数据, shutdown在关闭前会再调用一次onMessage, 最终可能会导致死循环)
-                context->reset();
+                session->reset();
                 buffer.clear();
                 // 关闭连接
                 conn->shutdown();
@@ -947,16 +1750,30 @@ private:
             
             // DF_DEBUG("获取到一个完整的HTTP请求");
             
-            //3.成功读取到一个完整的request，走到这里request才是有效的，路由找到业务函数handler
-            HttpRequest request = context->getRequest();
+            //3.成功读取到一个完整的request，走到这里request才是有效的，业务函数handler在首部到齐时已经找到
+            // 直接使用上下文中的请求对象（不拷贝），处理完后随上下文一起重置
+            HttpRequest &request = context->getRequest();
             // request.printRequestInfo();
 
-            auto handler = route(request, response);
+            if(session->_writer_handler)
+            {
+                // 流式响应：处理函数通过writer发送，可以在返回之后继续，结束后由onResponseEnd接着处理后面的请求
+                bool close = request.close() || _server.isDraining();
+                session->_writer = std::make_shared<ResponseWriter>(conn, request, close,
+                    std::bind(&HttpServer::onResponseEnd, this, std::placeholders::_1, std::placeholders::_2));
+                PtrResponseWriter writer = session->_writer;
+                WriterHandler writer_handler = std::move(session->_writer_handler);
+                writer_handler(request, writer);
+                return;
+            }
+            Handler handler = std::move(session->_handler);
             if(!handler)
             {
                 // 路由失败，不能业务处理
+                response._stat_code = session->_route_stat;
                 errorPageResponse(response);
                 writeResponse(conn, request, response);
+                session->reset();
                 buffer.clear();
                 conn->shutdown();
                 return;
@@ -970,17 +1787,64 @@ private:
             //5.将响应返回给客户端
             writeResponse(conn, request, response);
 
-            //6.长短连接的判断
-            if(request.close())
+            //6.长短连接的判断（服务器正在停止时不再保持长连接）
+            if(request.close() || _server.isDraining())
             {
                 //短连接关闭
-                // DF_DEBUG("关闭短连接, %d", conn->Id());
+                // DF_DEBUG("关闭短连接, %" PRIu64, conn->Id());
+                // 后面的请求不再处理，先重置上下文、清空缓冲区，避免shutdown关闭前把它们当作新请求再处理一遍
+                session->reset();
+                buffer.clear();
                 conn->shutdown();
                 return;
             }
             // 长连接，循环处理，先重置上下文
             // 长连接是否有效? TODO
-            context->reset();
+            session->reset();
+        }
+    }
+
+    // 流式响应结束：长连接重置上下文，在任务队列中接着处理读缓冲区中后面的请求
+    void onResponseEnd(const PtrConnection &conn, bool close)
+    {
+        HttpSession* session = conn->getContext()->get<HttpSession>();
+        session->_writer.reset();
+        session->reset();
+        if(!conn->isConnected())
+        {
+            // 连接已经关闭或正在关闭，不再处理后面的请求
+            return;
+        }
+        if(close)
+        {
+            // 后面的请求不再处理：先重置上下文、丢弃读缓冲区，shutdown关闭前不会把它们当作新请求再解析一遍
+            conn->discardInput();
+            conn->shutdown();
+            return;
+        }
+        if(conn->inputBytes() > 0)
+        {
+            conn->resumeInput();
+        }
+    }
+
+    // 输出队列降到低水位、连接关闭时通知正在进行的流式响应（连接关闭时同时解除连接与writer的相互引用）
+    void onLowWaterMark(const PtrConnection &conn)
+    {
+        HttpSession* session = conn->getContext()->get<HttpSession>();
+        if(session->_writer)
+        {
+            PtrResponseWriter writer = session->_writer;
+            writer->notifyWritable();
+        }
+    }
+    void onClosed(const PtrConnection &conn)
+    {
+        HttpSession* session = conn->getContext()->get<HttpSession>();
+        if(session->_writer)
+        {
+            PtrResponseWriter writer = std::move(session->_writer);
+            writer->notifyWritable();
         }
     }
 
@@ -1004,7 +1868,7 @@ private:
     void writeResponse(const PtrConnection & conn, const HttpRequest& request, HttpResponse& response)
     {
         // 1.为response填充一些必要的信息
-        if(request.close()) 
+        if(request.close() || _server.isDraining()) 
         {
             response.setHeader("Connection", "close");//短连接
         } 
@@ -1013,11 +1877,12 @@ private:
             response.setHeader("Connection", "keep-alive");//长连接
         }
 
-        if(!response._body.empty() && !response.hasHeader("Content-Length"))
+        size_t body_len = response.bodyLength();
+        if(body_len > 0 && !response.hasHeader("Content-Length"))
         {
-            response.setHeader("Content-Length", std::to_string(response._body.size()));
+            response.setHeader("Content-Length", std::to_string(body_len));
         }
-        if(!response._body.empty() && !response.hasHeader("Content-Type"))
+        if(body_len > 0 && !response.hasHeader("Content-Type"))
         {
             response.setHeader("Content-Type", "application/octet-stream");
         }
@@ -1025,58 +1890,88 @@ private:
         {
             response.setHeader("Location", response._redirect_url);
         }
-        response._version = request._version.empty() ? "HTTP/1.1" : request._version;//避免request无效的情况
+        response._version = request.version().empty() ? "HTTP/1.1" : request.version();//避免request无效的情况
 
         // 2.将response对象序列化
         std::string resp_str = response.serialize();
-        DF_DEBUG("response str: %s", resp_str.c_str());
+        DF_DEBUG("response: %d, body length: %zu", response._stat_code, body_len);
 
-        // 3.返回响应
-        conn->send(resp_str.c_str(), resp_str.size());
+        // 3.返回响应（响应字符串整体移交给输出队列，不再拷贝）
+        conn->send(std::move(resp_str));
+        // 文件响应体紧跟在头部之后用sendfile发送（HEAD请求只要头部）
+        if(response._file_body && request.method() != "HEAD")
+        {
+            conn->sendFile(response._file_body, 0, response._file_body->size());
+        }
     }
 
     // 根据request请求信息，返回从路由表中找到的业务处理函数，找不到则通过response返回错误信息Method Not Allowed
-    Handler route(HttpRequest &request, HttpResponse &response)
+    Handler route(HttpSession &session, HttpResponse &response)
     {
+        HttpRequest &request = session._context.getRequest();
         // 判断是否为静态资源请求
         if (isStaticResourceRequest(request))
         {
             return std::bind(&HttpServer::staticResourceHandler, this, std::placeholders::_1, std::placeholders::_2);
         }
 
-        if (request._method == "GET")
+        if (request.method() == "GET")
         {
-            return routeInMap(request, response, _get_router);
+            return routeInMap(session, response, _get_router);
         }
-        if (request._method == "POST")
+        if (request.method() == "POST")
         {
-            return routeInMap(request, response, _post_router);
+            return routeInMap(session, response, _post_router);
         }
-        if (request._method == "PUT")
+        if (request.method() == "PUT")
         {
-            return routeInMap(request, response, _put_router);
+            return routeInMap(session, response, _put_router);
         }
-        if (request._method == "DELETE")
+        if (request.method() == "DELETE")
         {
-            return routeInMap(request, response, _delete_router);
+            return routeInMap(session, response, _delete_router);
         }
         // 请求方法不合法，通过response返回错误信息Method Not Allowed
         response._stat_code = 405;
         return Handler();
     }
 
-    Handler routeInMap(HttpRequest &request, HttpResponse &response, HandlerMap &handlers)
+    Handler routeInMap(HttpSession &session, HttpResponse &response, HandlerMap &handlers)
     {
+        HttpContext &context = session._context;
+        HttpRequest &request = context.getRequest();
         // 遍历整个handlers表，请求url与每一个正则表达式尝试匹配，匹配成功则返回对应的方法handler
         for (auto &h : handlers)
         {
-            auto reg = h.first;
-            auto handler = h.second;
-            bool is_match = std::regex_match(request._url, request._matches, reg);
-            if (is_match)
+            bool is_match = std::regex_match(request.path(), request._matches, h.pattern);
+            if (!is_match)
+            {
+                continue;
+            }
+            if (h.writer)
+            {
+                session._writer_handler = h.writer;
+                return Handler();
+            }
+            if (!h.stream)
+            {
+                return h.handler;
+            }
+            // 流式路由：请求体交给onBodyChunk（没有设置时丢弃），请求完整后由onBodyEnd生成响应
+            BodyStream stream = h.stream(request);
+            if (stream.onBodyChunk)
+            {
+                context.setBodyCallback(stream.onBodyChunk);
+            }
+            else
+            {
+                context.setBodyCallback([](const char *, size_t) {});
+            }
+            if (stream.onBodyEnd)
             {
-                return handler;
+                return stream.onBodyEnd;
             }
+            return [](const HttpRequest &, HttpResponse &) {};
         }
         // url匹配失败，Not Found
         response._stat_code = 404;
@@ -1093,20 +1988,20 @@ private:
         }
 
         // 请求方法必须是Get or Head
-        if(request._method != "GET" && request._method != "HEAD")
+        if(request.method() != "GET" && request.method() != "HEAD")
         {
             return false;
         }
 
         // 请求资源路径必须合法（相对路径）
-        if(!Util::isVaildPath(request._resource_path))
+        if(!Util::isVaildPath(request.path()))
         {
             return false;
         }
 
         // 加上base_dir后的绝对路径也必须合法
         // 特殊情况，路径为：'xxx/'，解析为 "base_dir/index.html"
-        std::string real_path = this->_base_dir + request._resource_path;
+        std::string real_path = this->_base_dir + request.path();
         if(real_path.back() == '/')
         {
             real_path += "index.html";
@@ -1122,27 +2017,28 @@ private:
 
     void staticResourceHandler(const HttpRequest& request, HttpResponse& response)
     {
-        // 将文件读取出来，填充到response的正文中，并修改一些header
-        std::string real_path = this->_base_dir + request._resource_path;
+        // 打开文件作为response的正文，并修改一些header
+        std::string real_path = this->_base_dir + request.path();
         if(real_path.back() == '/')
         {
             real_path += "index.html";
         }
 
-        std::string data;
-        if(!Util::readFile(real_path, data))
+        // 文件内容不读入内存，交给连接用sendfile发送
+        OutputQueue::FilePtr file = FileHandle::Open(real_path);
+        if(!file)
         {
             //服务器内部错误
             response._stat_code = 500;
             return;
         }
 
-        response._body = data;
-        response.setHeader("Content-Type",Util::getMimeType(real_path));
+        response.setFileBody(file, Util::getMimeType(real_path));
     }
 
 public:
-    HttpServer(uint32_t port, size_t work_thread_count = 2, bool enable_inactive_close = true, int timeout = DEFAULT_ACTIVE_TIMEOUT) :_server(port)
+    HttpServer(uint32_t port, size_t work_thread_count = 2, bool enable_inactive_close = true, int timeout = DEFAULT_ACTIVE_TIMEOUT,
+               PollerBackend backend = EPOLL_BACKEND) :_server(port, backend)
     {
         // 设置loop线程数
         _server.setThreadCount(work_thread_count);
@@ -1154,6 +2050,10 @@ public:
         // 设置server的连接建立回调和消息回调
         _server.setConnectedCallback(std::bind(&HttpServer::onConnected, this, std::placeholders::_1));
         _server.setMessageCallback(std::bind(&HttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2));
+        _server.setLowWaterMarkCallback(std::bind(&HttpServer::onLowWaterMark, this, std::placeholders::_1));
+        // 输出队列水位：流式响应按连接的水位暂停、恢复生成响应体
+        _server.setWaterMarks(DEFAULT_HIGH_WATER, DEFAULT_LOW_WATER);
+        _server.setClosedCallback(std::bind(&HttpServer::onClosed, this, std::placeholders::_1));
     }
 
     // 设置静态资源根目录
@@ -1166,23 +2066,56 @@ public:
     // 设置各种请求方法的路由项
     void Get(const std::string pattern, const Handler &handler)
     {
-        _get_router.push_back(std::make_pair(std::regex(pattern), handler));
+        _get_router.push_back(Route{std::regex(pattern), handler, nullptr, nullptr});
     }
     void Post(const std::string pattern, const Handler &handler)
     {
-        _post_router.push_back(std::make_pair(std::regex(pattern), handler));
+        _post_router.push_back(Route{std::regex(pattern), handler, nullptr, nullptr});
     }
     void Put(const std::string pattern, const Handler &handler)
     {
-        _put_router.push_back(std::make_pair(std::regex(pattern), handler));
+        _put_router.push_back(Route{std::regex(pattern), handler, nullptr, nullptr});
     }
     void Delete(const std::string pattern, const Handler &handler)
     {
-        _delete_router.push_back(std::make_pair(std::regex(pattern), handler));
+        _delete_router.push_back(Route{std::regex(pattern), handler, nullptr, nullptr});
+    }
+    // 流式接收请求体的路由项（大文件上传等）：请求体不在内存中累积，每个请求占用的内存不超过连接的输入缓冲区
+    void PostStream(const std::string pattern, const StreamHandler &handler)
+    {
+        _post_router.push_back(Route{std::regex(pattern), nullptr, handler, nullptr});
+    }
+    void PutStream(const std::string pattern, const StreamHandler &handler)
+    {
+        _put_router.push_back(Route{std::regex(pattern), nullptr, handler, nullptr});
+    }
+    // 流式发送响应的路由项（导出、报表等较大的生成内容）：先发送首部，边生成边发送，首字节不必等全部内容生成
+    void GetWriter(const std::string pattern, const WriterHandler &handler)
+    {
+        _get_router.push_back(Route{std::regex(pattern), nullptr, nullptr, handler});
+    }
+    void PostWriter(const std::string pattern, const WriterHandler &handler)
+    {
+        _post_router.push_back(Route{std::regex(pattern), nullptr, nullptr, handler});
+    }
+    // 服务器开始运行（Stop之后返回）
+    // 设置连接输出队列的水位（见TcpServer::setWaterMarks），Listen之前调用
+    void SetWaterMarks(size_t high, size_t low, uint32_t evict_ms = 0)
+    {
+        _server.setWaterMarks(high, low, evict_ms);
     }
-    // 服务器开始运行
     void Listen()
     {
         _server.start();
     }
+    // 平滑停止（任意线程可调用）：不再接受新连接，处理完的长连接随响应关闭，最多等待drain_ms毫秒
+    void Stop(uint32_t drain_ms = TcpServer::DEFAULT_DRAIN_MS)
+    {
+        _server.stop(drain_ms);
+    }
+    // 启用监听套接字交接，新版本进程接过监听套接字后本进程平滑停止（Listen之前设置）
+    void EnableHandoff(const std::string &path, uint32_t drain_ms = TcpServer::DEFAULT_DRAIN_MS)
+    {
+        _server.enableHandoff(path, drain_ms);
+    }
 };
\ No newline at end of file
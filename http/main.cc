@@ -3,6 +3,32 @@
 
 #define BASE_DIR "/home/kf/tcp-server/http/wwwroot"
 
+// 流式导出：每次生成一批数据发送，输出队列积压时等待发送完毕再继续生成
+struct ExportTask : std::enable_shared_from_this<ExportTask>
+{
+    PtrResponseWriter writer;
+    int row = 0;
+    int rows = 0;
+
+    void run()
+    {
+        while(row < rows && writer->writable()){
+            std::string batch;
+            for(int i = 0; i < 100 && row < rows; i++, row++){
+                batch += std::to_string(row) + ",item-" + std::to_string(row) + "\n";
+            }
+            if(!writer->write(std::move(batch))){
+                return;//连接已关闭
+            }
+        }
+        if(row < rows){
+            writer->onWritable(std::bind(&ExportTask::run, shared_from_this()));
+            return;
+        }
+        writer->end();
+    }
+};
+
 int main()
 {
     HttpServer svr(8777, 3, true, 100);
@@ -58,18 +84,36 @@ int main()
         return;
     });
 
-    svr.Put("/upload/big.txt", [](const HttpRequest &request, HttpResponse &response){
-        //保存文件内容
+    svr.PutStream("/upload/big.txt", [](const HttpRequest &){
+        //边接收边写入文件，文件内容不在内存中累积
         std::string path = BASE_DIR;
         path += "/big.txt";
-        if(Util::writeFile(path, request._body)){
-            response._stat_code = 200;
-        }else{
-            response._stat_code = 500;
-        }
-        return;
+        auto file = std::make_shared<std::ofstream>(path, std::ios::binary | std::ios::trunc);
+        HttpServer::BodyStream stream;
+        stream.onBodyChunk = [file](const char *data, size_t len){
+            file->write(data, len);
+        };
+        stream.onBodyEnd = [file](const HttpRequest &, HttpResponse &response){
+            file->close();
+            if(*file){
+                response._stat_code = 200;
+            }else{
+                response._stat_code = 500;
+            }
+        };
+        return stream;
     });
 
+    svr.GetWriter("/export", [](const HttpRequest &, const PtrResponseWriter &writer){
+        //先发送首部，再边生成边分块发送
+        HttpResponse response(200);
+        response.setHeader("Content-Type", "text/csv");
+        writer->writeHead(response);
+        auto task = std::make_shared<ExportTask>();
+        task->writer = writer;
+        task->rows = 1000000;
+        task->run();
+    });
 
     svr.Listen();
     return 0;
@@ -292,7 +292,7 @@ namespace ckflogs
             // [%%%%d{%H:%m:%S}][%L][%f:%l][%m]%n
             std::string value;
             bool in_brace = false;
-            for (int i = 0; i < pattern_.size(); i++)
+            for (size_t i = 0; i < pattern_.size(); i++)
             {
                 if (pattern_[i] != '%' || in_brace) // 如果检测到当前i指向在{}里面，可以直接跳过，{}里的内容不应该在此处理
                 {
@@ -323,11 +323,11 @@ namespace ckflogs
                 value.clear();
 
                 // 查看格式标识符后面有没有子格式{}, 有的话保存到value
-                int keyi = i;
+                size_t keyi = i;
                 if (keyi + 1 < pattern_.size() && pattern_[keyi + 1] == '{')
                 {
                     // 找'}'
-                    int begin = keyi + 2, end = begin;
+                    size_t begin = keyi + 2, end = begin;
                     while (end < pattern_.size() && pattern_[end] != '}')
                         end++;
                     if (end >= pattern_.size()) // 没找到'}'
@@ -389,7 +389,7 @@ bool ckflogs::DateFormatItem::dateToString(std::string *ret, time_t ctime)
 {
     util::Date date(ctime);
     // %H:%m:%S
-    for (int i = 0; i < date_fmt_.size(); i++)
+    for (size_t i = 0; i < date_fmt_.size(); i++)
     {
         if (date_fmt_[i] != '%')
         {
@@ -34,6 +34,8 @@ namespace ckflogs
                 return "FATAL";
             case OFF:
                 return "OFF";
+            case UNKNOW:
+                break;
             }
             return "UNKNOW";
         }
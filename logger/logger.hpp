@@ -56,9 +56,9 @@ namespace ckflogs
                const Formatter &formatter,
                const std::vector<LogSinker::Ptr> &sinkers)
             : name_(name),
-              limit_level_(limit_level),
               formatter_(formatter),
-              sinkers_(sinkers) {}
+              sinkers_(sinkers),
+              limit_level_(limit_level) {}
 
         virtual ~Logger() {}
 
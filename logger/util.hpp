@@ -86,7 +86,7 @@ namespace ckflogs
                     return false;
                 if (File::exist(dir))
                     return true;
-                int index = 0;
+                size_t index = 0;
                 mode_t dir_mode = 0777;
 
                 while (index < dir.size())
@@ -9,6 +9,13 @@
 #include <typeinfo>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <unordered_set>
+#include <climits>
+#include <cinttypes>
+#include <cstddef>
+#include <new>
+#include <type_traits>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -20,6 +27,22 @@
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <dirent.h>
+#include <linux/io_uring.h>
+#include <linux/mempolicy.h>
+#include <linux/filter.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <atomic>
 
 #include "../logger/ckflog.hpp"
 
@@ -111,34 +134,596 @@ private:
     Holder *_content;
 };
 
+/*
+
+    InplaceFunction：内联存储的可调用对象（只能移动，不能拷贝）
+    可调用对象不超过Capacity字节时直接放在对象内部，构造、移动、调用都不分配内存；超过时才退回堆上存放
+    默认容量56字节，加上操作表指针，整个对象正好64字节
+
+*/
+template <class Signature, size_t Capacity = 56>
+class InplaceFunction;
+
+template <class R, class... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+    // 类型擦除的操作表，每种可调用对象类型一份
+    struct Ops
+    {
+        R (*invoke)(void *storage, Args &&...args);
+        void (*move)(void *dst, void *src); // 移动到dst，并销毁src
+        void (*destroy)(void *storage);
+    };
+
+    // 可调用对象直接放在内部存储中
+    template <class Fn>
+    struct InlineOps
+    {
+        static R invoke(void *storage, Args &&...args)
+        {
+            return (*static_cast<Fn *>(storage))(std::forward<Args>(args)...);
+        }
+        static void move(void *dst, void *src)
+        {
+            new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+            static_cast<Fn *>(src)->~Fn();
+        }
+        static void destroy(void *storage)
+        {
+            static_cast<Fn *>(storage)->~Fn();
+        }
+        static const Ops *get()
+        {
+            static const Ops ops = {&invoke, &move, &destroy};
+            return &ops;
+        }
+    };
+
+    // 可调用对象放在堆上，内部存储只保存指针
+    template <class Fn>
+    struct HeapOps
+    {
+        static R invoke(void *storage, Args &&...args)
+        {
+            return (**static_cast<Fn **>(storage))(std::forward<Args>(args)...);
+        }
+        static void move(void *dst, void *src)
+        {
+            *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+        }
+        static void destroy(void *storage)
+        {
+            delete *static_cast<Fn **>(storage);
+        }
+        static const Ops *get()
+        {
+            static const Ops ops = {&invoke, &move, &destroy};
+            return &ops;
+        }
+    };
+
+    template <class Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= Capacity && alignof(Fn) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    // 空的函数指针、std::function构造出的也是空对象
+    template <class T>
+    static bool isNull(const T &)
+    {
+        return false;
+    }
+    template <class T>
+    static bool isNull(T *ptr)
+    {
+        return ptr == nullptr;
+    }
+    template <class S>
+    static bool isNull(const std::function<S> &fn)
+    {
+        return !fn;
+    }
+
+public:
+    InplaceFunction() : _ops(nullptr) {}
+    InplaceFunction(std::nullptr_t) : _ops(nullptr) {}
+
+    template <class F, class Fn = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<Fn, InplaceFunction>::value>::type>
+    InplaceFunction(F &&f) : _ops(nullptr)
+    {
+        if (isNull(f))
+        {
+            return;
+        }
+        construct<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    InplaceFunction(InplaceFunction &&other) noexcept : _ops(other._ops)
+    {
+        if (_ops)
+        {
+            _ops->move(_storage, other._storage);
+            other._ops = nullptr;
+        }
+    }
+    InplaceFunction &operator=(InplaceFunction &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other._ops)
+            {
+                other._ops->move(_storage, other._storage);
+                _ops = other._ops;
+                other._ops = nullptr;
+            }
+        }
+        return *this;
+    }
+    InplaceFunction &operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+    InplaceFunction(const InplaceFunction &) = delete;
+    InplaceFunction &operator=(const InplaceFunction &) = delete;
+
+    ~InplaceFunction()
+    {
+        reset();
+    }
+
+    R operator()(Args... args) const
+    {
+        assert(_ops);
+        return _ops->invoke(const_cast<unsigned char *>(_storage), std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const
+    {
+        return _ops != nullptr;
+    }
+
+private:
+    template <class Fn, class F>
+    void construct(F &&f, std::true_type)
+    {
+        new (_storage) Fn(std::forward<F>(f));
+        _ops = InlineOps<Fn>::get();
+    }
+    template <class Fn, class F>
+    void construct(F &&f, std::false_type)
+    {
+        *reinterpret_cast<Fn **>(_storage) = new Fn(std::forward<F>(f));
+        _ops = HeapOps<Fn>::get();
+    }
+
+    void reset()
+    {
+        if (_ops)
+        {
+            _ops->destroy(_storage);
+            _ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) unsigned char _storage[Capacity]; // 内联存储
+    const Ops *_ops;                                             // 操作表（nullptr表示空）
+};
+
+/*
+
+    ByteScan分隔符扫描
+
+*/
+// 在字节序列中查找分隔符，按CPU支持的指令集选择实现（AVX2每次比较32字节、SSE2每次16字节，其它平台逐字节）
+// 指令集在第一次使用时检测，之后通过函数指针调用；返回第一个匹配的下标，找不到返回n
+class ByteScan
+{
+public:
+    enum Level
+    {
+        SCALAR, // 逐字节
+        SSE2,   // 16字节向量
+        AVX2,   // 32字节向量
+    };
+
+    // 查找"\r\n"，返回'\r'的下标（最后一个字节是'\r'时不算找到）
+    static size_t findCRLF(const char *p, size_t n)
+    {
+        return kernels().crlf(p, n);
+    }
+    // 查找第一个控制字符（小于0x20的字节和0x7f，不包括'\t'），HTTP头部字段值在遇到'\r'或非法字符时结束
+    static size_t findCtl(const char *p, size_t n)
+    {
+        return kernels().ctl(p, n);
+    }
+
+    // 当前使用的实现
+    static Level level()
+    {
+        return kernels().level;
+    }
+    static const char *levelName(Level level)
+    {
+        return level == AVX2 ? "avx2" : level == SSE2 ? "sse2" : "scalar";
+    }
+    // 指定使用的实现（不超过CPU支持的级别），返回实际使用的级别；用于基准测试对比，应在服务器启动之前调用
+    static Level setLevel(Level level)
+    {
+        kernels() = select(std::min(level, detect()));
+        return kernels().level;
+    }
+
+private:
+    struct Kernels
+    {
+        size_t (*crlf)(const char *p, size_t n);
+        size_t (*ctl)(const char *p, size_t n);
+        Level level;
+    };
+
+    static Kernels &kernels()
+    {
+        static Kernels table = select(detect());
+        return table;
+    }
+
+    static Level detect()
+    {
+#if defined(__x86_64__)
+        return __builtin_cpu_supports("avx2") ? AVX2 : SSE2;
+#else
+        return SCALAR;
+#endif
+    }
+
+    static Kernels select(Level level)
+    {
+#if defined(__x86_64__)
+        if (level == AVX2)
+        {
+            return Kernels{crlfAvx2, ctlAvx2, AVX2};
+        }
+        if (level == SSE2)
+        {
+            return Kernels{crlfSse2, ctlSse2, SSE2};
+        }
+#endif
+        return Kernels{crlfScalar, ctlScalar, SCALAR};
+    }
+
+    static bool isCtl(char c)
+    {
+        return ((unsigned char)c < 0x20 && c != '\t') || c == 0x7f;
+    }
+    static size_t crlfScalar(const char *p, size_t n)
+    {
+        for (size_t i = 0; i + 1 < n; i++)
+        {
+            if (p[i] == '\r' && p[i + 1] == '\n')
+            {
+                return i;
+            }
+        }
+        return n;
+    }
+    static size_t ctlScalar(const char *p, size_t n)
+    {
+        size_t i = 0;
+        while (i < n && !isCtl(p[i]))
+        {
+            i++;
+        }
+        return i;
+    }
+
+#if defined(__x86_64__)
+    // 每次比较[i, i+16)中的'\r'和[i+1, i+17)中的'\n'，两个掩码相与就是"\r\n"的位置
+    static size_t crlfSse2(const char *p, size_t n)
+    {
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        size_t i = 0;
+        for (; i + 17 <= n; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(p + i + 1));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, cr)) & _mm_movemask_epi8(_mm_cmpeq_epi8(b, lf));
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        size_t tail = crlfScalar(p + i, n - i);
+        return i + tail;
+    }
+    // 控制字符：无符号 x <= 0x1f（min(x, 0x1f) == x）且不是'\t'，或者 x == 0x7f
+    static size_t ctlSse2(const char *p, size_t n)
+    {
+        const __m128i low = _mm_set1_epi8(0x1f);
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i del = _mm_set1_epi8(0x7f);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i ctl = _mm_andnot_si128(_mm_cmpeq_epi8(x, tab), _mm_cmpeq_epi8(_mm_min_epu8(x, low), x));
+            int mask = _mm_movemask_epi8(_mm_or_si128(ctl, _mm_cmpeq_epi8(x, del)));
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + ctlScalar(p + i, n - i);
+    }
+
+    __attribute__((target("avx2"))) static size_t crlfAvx2(const char *p, size_t n)
+    {
+        const __m256i cr = _mm256_set1_epi8('\r');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        size_t i = 0;
+        for (; i + 33 <= n; i += 32)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 1));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, cr)) & (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, lf));
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + crlfSse2(p + i, n - i);
+    }
+    __attribute__((target("avx2"))) static size_t ctlAvx2(const char *p, size_t n)
+    {
+        const __m256i low = _mm256_set1_epi8(0x1f);
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i del = _mm256_set1_epi8(0x7f);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+            __m256i ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(x, tab), _mm256_cmpeq_epi8(_mm256_min_epu8(x, low), x));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(x, del)));
+            if (mask != 0)
+            {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + ctlSse2(p + i, n - i);
+    }
+#endif
+};
+
 /*
 
     Buffer缓冲区模块
 
 */
+// 缓冲区内存池的统计信息
+struct BufferPoolStats
+{
+    uint64_t hits = 0;          // 直接从空闲链表取得内存块的次数
+    uint64_t misses = 0;        // 需要向系统申请内存的次数
+    uint64_t in_use_chunks = 0; // 正在被Buffer使用的内存块数
+    uint64_t in_use_bytes = 0;  // 正在被Buffer使用的字节数
+    uint64_t cached_chunks = 0; // 池中空闲的内存块数
+    uint64_t cached_bytes = 0;  // 池中空闲的字节数
+    uint64_t trimmed_bytes = 0; // 空闲收缩时归还给系统的字节数
+
+    BufferPoolStats &operator+=(const BufferPoolStats &other)
+    {
+        hits += other.hits;
+        misses += other.misses;
+        in_use_chunks += other.in_use_chunks;
+        in_use_bytes += other.in_use_bytes;
+        cached_chunks += other.cached_chunks;
+        cached_bytes += other.cached_bytes;
+        trimmed_bytes += other.trimmed_bytes;
+        return *this;
+    }
+};
+
+// 缓冲区内存池：每个EventLoop一个，只在所属线程中申请和归还，按 4KB、8KB ... 1MB 分规格缓存空闲内存块
+// （超过最大规格的内存块不缓存，直接向系统申请和归还）
+class BufferPool
+{
+public:
+    static const size_t MIN_CHUNK_SIZE = 4096;            // 最小规格
+    static const size_t CLASS_COUNT = 9;                  // 规格数量（4KB << 0 ~ 4KB << 8）
+    static const size_t MAX_CACHED_PER_CLASS = 8ul << 20; // 每个规格最多缓存的空闲字节数
+
+    BufferPool() {}
+    ~BufferPool()
+    {
+        for (auto &free_list : _free_lists)
+        {
+            for (char *chunk : free_list.chunks)
+            {
+                ::operator delete(chunk);
+            }
+        }
+    }
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    // 申请至少size字节的内存块，cap返回内存块的实际大小
+    char *allocate(size_t size, size_t *cap)
+    {
+        size_t idx = classIndex(size);
+        char *chunk = nullptr;
+        if (idx < CLASS_COUNT && !_free_lists[idx].chunks.empty())
+        {
+            FreeList &free_list = _free_lists[idx];
+            *cap = classSize(idx);
+            chunk = free_list.chunks.back();
+            free_list.chunks.pop_back();
+            free_list.low_water = std::min(free_list.low_water, free_list.chunks.size());
+            free_list.bytes -= *cap;
+            add(_hits, 1);
+            add(_cached_chunks, -1);
+            add(_cached_bytes, -(int64_t)*cap);
+        }
+        else
+        {
+            *cap = idx < CLASS_COUNT ? classSize(idx) : size;
+            chunk = (char *)::operator new(*cap);
+            add(_misses, 1);
+        }
+        add(_in_use_chunks, 1);
+        add(_in_use_bytes, *cap);
+        return chunk;
+    }
+
+    // 归还内存块，cap必须是allocate返回的大小
+    void deallocate(char *chunk, size_t cap)
+    {
+        add(_in_use_chunks, -1);
+        add(_in_use_bytes, -(int64_t)cap);
+        size_t idx = classIndex(cap);
+        if (idx >= CLASS_COUNT || _free_lists[idx].bytes + cap > MAX_CACHED_PER_CLASS)
+        {
+            ::operator delete(chunk);
+            return;
+        }
+        FreeList &free_list = _free_lists[idx];
+        free_list.chunks.push_back(chunk);
+        free_list.bytes += cap;
+        add(_cached_chunks, 1);
+        add(_cached_bytes, cap);
+    }
+
+    // 空闲收缩（周期性调用）：上一个周期内空闲链表一直没有用到的那部分内存块归还给系统
+    void shrinkIdle()
+    {
+        for (size_t idx = 0; idx < CLASS_COUNT; idx++)
+        {
+            FreeList &free_list = _free_lists[idx];
+            size_t n = std::min(free_list.low_water, free_list.chunks.size());
+            for (size_t i = 0; i < n; i++)
+            {
+                ::operator delete(free_list.chunks.back());
+                free_list.chunks.pop_back();
+            }
+            size_t bytes = n * classSize(idx);
+            free_list.bytes -= bytes;
+            free_list.low_water = free_list.chunks.size();
+            if (n == 0 && free_list.chunks.empty())
+            {
+                // 释放空闲链表自身的空间
+                std::vector<char *>().swap(free_list.chunks);
+            }
+            add(_cached_chunks, -(int64_t)n);
+            add(_cached_bytes, -(int64_t)bytes);
+            add(_trimmed_bytes, bytes);
+        }
+    }
+
+    // 获取统计信息（任意线程可调用）
+    BufferPoolStats stats() const
+    {
+        BufferPoolStats st;
+        st.hits = _hits.load(std::memory_order_relaxed);
+        st.misses = _misses.load(std::memory_order_relaxed);
+        st.in_use_chunks = _in_use_chunks.load(std::memory_order_relaxed);
+        st.in_use_bytes = _in_use_bytes.load(std::memory_order_relaxed);
+        st.cached_chunks = _cached_chunks.load(std::memory_order_relaxed);
+        st.cached_bytes = _cached_bytes.load(std::memory_order_relaxed);
+        st.trimmed_bytes = _trimmed_bytes.load(std::memory_order_relaxed);
+        return st;
+    }
+
+private:
+    struct FreeList
+    {
+        std::vector<char *> chunks; // 空闲内存块
+        size_t bytes = 0;           // 空闲字节数
+        size_t low_water = 0;       // 本周期内空闲块数量的最低点
+    };
+
+    static size_t classSize(size_t idx)
+    {
+        return MIN_CHUNK_SIZE << idx;
+    }
+    // 能容纳size字节的最小规格，超过最大规格时返回CLASS_COUNT
+    static size_t classIndex(size_t size)
+    {
+        size_t idx = 0;
+        while (idx < CLASS_COUNT && classSize(idx) < size)
+        {
+            idx++;
+        }
+        return idx;
+    }
+    // 统计值只有所属线程修改，其它线程只读，不需要原子的读-改-写
+    static void add(std::atomic<uint64_t> &counter, int64_t delta)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+private:
+    FreeList _free_lists[CLASS_COUNT]; // 每个规格的空闲链表
+
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _in_use_chunks{0};
+    std::atomic<uint64_t> _in_use_bytes{0};
+    std::atomic<uint64_t> _cached_chunks{0};
+    std::atomic<uint64_t> _cached_bytes{0};
+    std::atomic<uint64_t> _trimmed_bytes{0};
+};
+
 class Buffer
 {
     using byte = char;
     static const size_t DEFAULT_BUF_SIZE = 8192;
 
 public:
+    // 独立使用的缓冲区，第一次写入时才申请size字节空间
     Buffer(size_t size = DEFAULT_BUF_SIZE)
-        : _buffer(size), _read_idx(0), _write_idx(0) {}
+        : _data(nullptr), _capacity(0), _init_size(size), _pool(nullptr), _read_idx(0), _write_idx(0) {}
+
+    // 由内存池提供空间的缓冲区：有数据时才申请，数据读完就归还给内存池（只能在内存池所属线程中使用）
+    explicit Buffer(BufferPool *pool, size_t size = DEFAULT_BUF_SIZE)
+        : _data(nullptr), _capacity(0), _init_size(size), _pool(pool), _read_idx(0), _write_idx(0) {}
+
+    ~Buffer()
+    {
+        releaseStorage();
+    }
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
 
     // 移动读指针
     void moveReadIdx(size_t len)
     {
         assert(len <= readableBytes());
         _read_idx += len;
+        consumeScanned(len);
+        onDrain();
     }
 
-    // 移动写指针
+    // 移动写指针（只能在写偏移之后的空间内移动）
     void moveWriteIdx(size_t len)
     {
-        assert(len <= writeableBytes());
+        assert(len <= tailWriteableBytes());
         _write_idx += len;
     }
 
+    // 确保已经申请了空间（延迟申请的缓冲区，在直接向writePos写入之前调用）
+    void ensureStorage()
+    {
+        if (_data == nullptr)
+        {
+            ensureEnoughWriteSpace(_init_size);
+        }
+    }
+
     /// @brief 向缓冲区写入数据
     /// @param data 写入数据的源地址，统一转成void*就不用管类型
     /// @param len 待写入的数据字节数
@@ -153,7 +738,7 @@ public:
 
         // 3.移动写偏移
         _write_idx += len;
-        assert(_write_idx <= _buffer.size());
+        assert(_write_idx <= _capacity);
     }
 
     void writeString(const std::string &str)
@@ -178,7 +763,9 @@ public:
 
         // 2.移动读偏移
         _read_idx += len;
-        assert(_read_idx <= _buffer.size());
+        assert(_read_idx <= _capacity);
+        consumeScanned(len);
+        onDrain();
     }
 
     // 获取一个长度为len的字符串
@@ -192,18 +779,39 @@ public:
     }
 
     // 获取读取一行（包含换行符，找不到换行符就不读取，返回空串）
+    // 换行符是"\r\n"时用ByteScan向量化查找，并且记住已经扫描过的位置：一行分多次到达时，每次只扫描新到的数据
     std::string getLine(const std::string &line_brk)
     {
         // DF_DEBUG("Buffer中的数据: %s", readPos());
-
-        char *CRLF = static_cast<char *>(memmem(readPos(), readableBytes(), line_brk.c_str(), line_brk.size()));
-        if (CRLF == nullptr)
+        if (empty())
         {
-            DF_DEBUG("没有找到换行符");
             return "";
         }
-        // 把"\\r\\n"也取出来
-        std::string line = readAsString(CRLF - readPos() + line_brk.size());
+        size_t len;
+        if (line_brk == "\r\n")
+        {
+            size_t pos = _line_scanned + ByteScan::findCRLF(readPos() + _line_scanned, readableBytes() - _line_scanned);
+            if (pos == readableBytes())
+            {
+                // 最后一个字节是'\r'时，'\n'可能还没到，下次从它开始
+                _line_scanned = pos - (readPos()[pos - 1] == '\r' ? 1 : 0);
+                DF_DEBUG("没有找到换行符");
+                return "";
+            }
+            len = pos + 2;
+        }
+        else
+        {
+            char *CRLF = static_cast<char *>(memmem(readPos(), readableBytes(), line_brk.c_str(), line_brk.size()));
+            if (CRLF == nullptr)
+            {
+                DF_DEBUG("没有找到换行符");
+                return "";
+            }
+            len = CRLF - readPos() + line_brk.size();
+        }
+        // 把"\r\n"也取出来
+        std::string line = readAsString(len);
         // DF_DEBUG("one line: %s", line.c_str());
         return line;
     }
@@ -212,6 +820,8 @@ public:
     void clear()
     {
         _read_idx = _write_idx = 0;
+        _line_scanned = 0;
+        onDrain();
     }
 
     // 判断缓冲区是否为空
@@ -229,12 +839,24 @@ public:
     // 获取可写数据大小
     size_t writeableBytes() const
     {
-        return _buffer.size() - readableBytes();
+        return _capacity - readableBytes();
+    }
+
+    // 获取写偏移之后的连续可写空间大小（不挪动数据、不扩容）
+    size_t tailWriteableBytes() const
+    {
+        return _capacity - _write_idx;
+    }
+
+    // 当前占用的空间大小（尚未申请或已归还时为0）
+    size_t capacity() const
+    {
+        return _capacity;
     }
 
     byte *begin()
     {
-        return &_buffer[0];
+        return _data;
     }
 
     byte *writePos()
@@ -252,17 +874,17 @@ private:
     void ensureEnoughWriteSpace(size_t len)
     {
         // 1.判断`write_idx`后的剩余空间是否足够
-        size_t backFreeSpace = _buffer.size() - _write_idx;
-        if (backFreeSpace >= len)
+        size_t backFreeSpace = _capacity - _write_idx;
+        if (_data != nullptr && backFreeSpace >= len)
         {
             return;
         }
 
         // 2.判断总体的剩余空间是否足够
-        if (writeableBytes() >= len)
+        size_t rbytes = readableBytes();
+        if (_data != nullptr && writeableBytes() >= len)
         {
             // 将数据挪到起始位置，读写偏移要跟着移动
-            size_t rbytes = readableBytes();
             std::copy(readPos(), readPos() + rbytes, begin());
             _read_idx = 0;
             _write_idx = rbytes;
@@ -270,27 +892,381 @@ private:
             return;
         }
 
-        // 3.扩容，保证写偏移之后有足够的空间
-        size_t newSize = _write_idx + len;
-        _buffer.resize(newSize);
+        // 3.换一块更大的空间（首次申请至少_init_size），只搬移未读数据
+        size_t cap = 0;
+        byte *data = allocate(std::max(rbytes + len, _init_size), &cap);
+        if (rbytes > 0)
+        {
+            std::copy(readPos(), readPos() + rbytes, data);
+        }
+        releaseStorage();
+        _data = data;
+        _capacity = cap;
+        _read_idx = 0;
+        _write_idx = rbytes;
     }
 
-private:
-    std::vector<byte> _buffer; // 缓冲区空间（以字节为单位）
-    size_t _read_idx;          // 读偏移
-    size_t _write_idx;         // 写偏移
-};
+    // 读走len字节后，getLine已扫描的范围（相对于读偏移）随之缩短
+    void consumeScanned(size_t len)
+    {
+        _line_scanned = _line_scanned > len ? _line_scanned - len : 0;
+    }
+
+    // 数据读完时复位读写偏移，由内存池提供的空间直接归还
+    void onDrain()
+    {
+        if (_read_idx != _write_idx)
+        {
+            return;
+        }
+        _read_idx = _write_idx = 0;
+        if (_pool != nullptr)
+        {
+            releaseStorage();
+        }
+    }
+
+    byte *allocate(size_t size, size_t *cap)
+    {
+        if (_pool != nullptr)
+        {
+            return _pool->allocate(size, cap);
+        }
+        *cap = size;
+        return (byte *)::operator new(size);
+    }
+
+    void releaseStorage()
+    {
+        if (_data == nullptr)
+        {
+            return;
+        }
+        if (_pool != nullptr)
+        {
+            _pool->deallocate(_data, _capacity);
+        }
+        else
+        {
+            ::operator delete(_data);
+        }
+        _data = nullptr;
+        _capacity = 0;
+    }
+
+private:
+    byte *_data;       // 缓冲区空间（以字节为单位，延迟申请）
+    size_t _capacity;  // 空间大小
+    size_t _init_size; // 首次申请的空间大小
+    BufferPool *_pool; // 提供空间的内存池（nullptr表示直接向系统申请）
+    size_t _read_idx;  // 读偏移
+    size_t _write_idx; // 写偏移
+
+    size_t _line_scanned = 0; // getLine已经扫描过、不含"\r\n"的字节数（从读偏移开始）
+};
+
+/*
+
+    FileHandle只读文件句柄
+
+*/
+class FileHandle
+{
+public:
+    // 以只读方式打开一个普通文件，失败返回nullptr
+    static std::shared_ptr<FileHandle> Open(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            DF_ERROR("Open file %s failed: %s", path.c_str(), strerror(errno));
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        {
+            DF_ERROR("File %s is not a regular file", path.c_str());
+            close(fd);
+            return nullptr;
+        }
+        return std::shared_ptr<FileHandle>(new FileHandle(fd, st.st_size));
+    }
+    ~FileHandle()
+    {
+        close(_fd);
+    }
+
+    int Fd() const
+    {
+        return _fd;
+    }
+    size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    FileHandle(int fd, size_t size) : _fd(fd), _size(size) {}
+    FileHandle(const FileHandle &) = delete;
+    FileHandle &operator=(const FileHandle &) = delete;
+
+private:
+    int _fd;      // 文件描述符
+    size_t _size; // 打开时的文件大小
+};
+
+/*
+
+    OutputQueue分段输出队列
+
+*/
+class OutputQueue
+{
+    static const size_t COALESCE_LIMIT = 16384; // 小块数据合并进尾部分段的上限
+
+public:
+    using Block = std::shared_ptr<const std::string>; // 共享的只读数据块，入队时不拷贝
+    using FilePtr = std::shared_ptr<FileHandle>;      // 文件分段，发送时走sendfile，不进入用户态
+
+private:
+    struct Segment
+    {
+        Block data;    // 内存分段的数据（文件分段时为空）
+        FilePtr file;  // 文件分段的文件（内存分段时为空）
+        size_t offset; // 下一个待发送字节的偏移
+        size_t end;    // 分段的结束偏移
+        bool owned;    // 是否为队列自己拷贝出来的分段（只有这种分段才能继续追加数据）
+
+        size_t remain() const
+        {
+            return end - offset;
+        }
+    };
+
+public:
+    OutputQueue() : _bytes(0) {}
+    ~OutputQueue()
+    {
+        clear();
+    }
+
+    // 同步累加待发送字节数到外部计数器（如所在EventLoop的负载统计），只能在队列所在线程修改
+    void setByteCounter(std::atomic<uint64_t> *counter)
+    {
+        _counter = counter;
+    }
+
+    // 拷贝一段数据入队，小块数据会合并进尾部分段，避免产生大量碎片
+    void append(const char *data, size_t len)
+    {
+        if (len == 0)
+        {
+            return;
+        }
+        if (!_segments.empty())
+        {
+            Segment &tail = _segments.back();
+            if (tail.owned && tail.data->size() + len <= COALESCE_LIMIT)
+            {
+                // 队列自己拷贝出来的分段不会被外部引用，可以安全地原地追加
+                const_cast<std::string &>(*tail.data).append(data, len);
+                tail.end += len;
+                addBytes(len);
+                _memory_bytes += len;
+                return;
+            }
+        }
+        // 分段本身按非const对象创建，之后通过const_cast原地追加才是合法的
+        _segments.push_back(Segment{std::make_shared<std::string>(data, len), nullptr, 0, len, true});
+        addBytes(len);
+        _memory_bytes += len;
+    }
+
+    // 接管一个字符串的所有权入队（不拷贝数据）
+    void append(std::string &&str)
+    {
+        if (str.empty())
+        {
+            return;
+        }
+        size_t len = str.size();
+        _segments.push_back(Segment{std::make_shared<const std::string>(std::move(str)), nullptr, 0, len, false});
+        addBytes(len);
+        _memory_bytes += len;
+    }
+
+    // 共享一个只读数据块入队（不拷贝数据，只增加引用计数）
+    void append(const Block &block)
+    {
+        if (!block || block->empty())
+        {
+            return;
+        }
+        _segments.push_back(Segment{block, nullptr, 0, block->size(), false});
+        addBytes(block->size());
+        _memory_bytes += block->size();
+    }
+
+    // 文件的[offset, offset+len)区间入队，发送时由内核直接从页缓存发往套接字
+    void appendFile(const FilePtr &file, size_t offset, size_t len)
+    {
+        if (!file || len == 0)
+        {
+            return;
+        }
+        _segments.push_back(Segment{nullptr, file, offset, offset + len, false});
+        addBytes(len);
+    }
+
+    // 用队首连续的内存分段填充iovec数组，最多max_iov个，遇到文件分段停止，返回填充的个数
+    int peekIov(struct iovec *iov, int max_iov) const
+    {
+        int cnt = 0;
+        for (auto it = _segments.begin(); it != _segments.end() && cnt < max_iov; ++it)
+        {
+            if (it->file)
+            {
+                break;
+            }
+            iov[cnt].iov_base = const_cast<char *>(it->data->data() + it->offset);
+            iov[cnt].iov_len = it->remain();
+            cnt++;
+        }
+        return cnt;
+    }
+
+    // 同peekIov，同时取得这些分段数据块的引用（异步发送时使用）：数据块在发送完成前保持有效，
+    // 这些分段之后也不再合并追加数据（原地追加可能使字符串重新分配，已提交的地址随之失效）
+    int pinIov(struct iovec *iov, int max_iov, std::vector<Block> *pinned)
+    {
+        int cnt = peekIov(iov, max_iov);
+        for (int i = 0; i < cnt; i++)
+        {
+            _segments[i].owned = false;
+            pinned->push_back(_segments[i].data);
+        }
+        return cnt;
+    }
+
+    // 队首是否为文件分段，是则返回其描述符、偏移和剩余长度
+    bool peekFile(int *fd, off_t *offset, size_t *len) const
+    {
+        if (_segments.empty() || !_segments.front().file)
+        {
+            return false;
+        }
+        const Segment &head = _segments.front();
+        *fd = head.file->Fd();
+        *offset = head.offset;
+        *len = head.remain();
+        return true;
+    }
+
+    // 第idx个分段是否为文件分段（用于决定前面的数据是否带MSG_MORE，和文件内容合并成满包发出）
+    bool isFileAt(size_t idx) const
+    {
+        return idx < _segments.size() && _segments[idx].file != nullptr;
+    }
+
+    // 从队首移除已发送的len个字节，发送完的分段随之释放
+    void consume(size_t len)
+    {
+        assert(len <= _bytes);
+        addBytes(-(int64_t)len);
+        while (len > 0)
+        {
+            Segment &head = _segments.front();
+            size_t remain = head.remain();
+            size_t used = std::min(len, remain);
+            if (!head.file)
+            {
+                _memory_bytes -= used;
+            }
+            if (len < remain)
+            {
+                head.offset += len;
+                return;
+            }
+            len -= remain;
+            _segments.pop_front();
+        }
+    }
+
+    // 清空队列
+    void clear()
+    {
+        _segments.clear();
+        addBytes(-(int64_t)_bytes);
+        _memory_bytes = 0;
+    }
+
+    // 获取待发送数据大小
+    size_t readableBytes() const
+    {
+        return _bytes;
+    }
+
+    // 内存分段中待发送的字节数（不含文件分段，文件内容不占用户态内存）
+    size_t memoryBytes() const
+    {
+        return _memory_bytes;
+    }
+
+    // 获取分段个数
+    size_t segmentCount() const
+    {
+        return _segments.size();
+    }
+
+    bool empty() const
+    {
+        return _bytes == 0;
+    }
+
+private:
+    void addBytes(int64_t delta)
+    {
+        _bytes += delta;
+        if (_counter && delta != 0)
+        {
+            _counter->fetch_add(delta, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::deque<Segment> _segments;             // 待发送的分段
+    size_t _bytes;                             // 待发送的总字节数
+    size_t _memory_bytes = 0;                  // 其中内存分段的字节数
+    std::atomic<uint64_t> *_counter = nullptr; // 外部计数器（可选）
+};
 
 /*
 
     Socket套接字模块
 
 */
+// 套接字调优参数（TcpServer::setSocketOptions），0/false表示保持系统默认
+// 全部设置在监听套接字上，accept得到的连接套接字在内核中继承（TCP_QUICKACK除外，它不持久，由连接自己设置）
+struct SocketOptions
+{
+    bool no_delay = false;          // TCP_NODELAY：关闭Nagle算法，小包立即发出
+    int send_buffer = 0;            // SO_SNDBUF（字节）
+    int recv_buffer = 0;            // SO_RCVBUF（字节），决定窗口扩大因子，必须在连接建立之前设置
+    int defer_accept_sec = 0;       // TCP_DEFER_ACCEPT：连接收到第一个数据包才可以accept（最多等待的秒数）
+    int fastopen_queue = 0;         // TCP_FASTOPEN：未完成三次握手的TFO请求队列长度
+    bool quick_ack = false;         // TCP_QUICKACK：立即回复ACK，不延迟确认
+    int busy_poll_us = 0;           // SO_BUSY_POLL（微秒）
+    int user_timeout_ms = 0;        // TCP_USER_TIMEOUT：发出的数据超过多久没有被确认就断开
+    int keepalive_idle_sec = 0;     // 开启SO_KEEPALIVE，连接空闲多久后开始探测（秒，0表示不开启）
+    int keepalive_interval_sec = 0; // 保活探测的间隔（秒，0表示系统默认）
+    int keepalive_count = 0;        // 保活探测几次没有回应后断开（0表示系统默认）
+};
+
 class Socket
 {
+public:
     static const int DEFAULT_BACKLOG = 64;
 
-public:
     Socket() : _sockfd(-1) {}
     ~Socket()
     {
@@ -342,18 +1318,39 @@ public:
         return true;
     }
 
+    // 取连接描述符对端地址的哈希键（IPv4为地址本身，IPv6折叠成32位），失败返回0
+    static uint32_t PeerAddressKey(int fd)
+    {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (getpeername(fd, (struct sockaddr *)&addr, &len) < 0)
+        {
+            return 0;
+        }
+        if (addr.ss_family == AF_INET)
+        {
+            return ntohl(((struct sockaddr_in *)&addr)->sin_addr.s_addr);
+        }
+        if (addr.ss_family == AF_INET6)
+        {
+            const uint32_t *words = (const uint32_t *)&((struct sockaddr_in6 *)&addr)->sin6_addr;
+            return words[0] ^ words[1] ^ words[2] ^ words[3];
+        }
+        return 0;
+    }
+
     // 返回-2表示还可以重新accpet
-    // 返回-1表示accpet异常
+    // 返回-1表示accpet异常（errno保留，由调用者判断）
+    // 新连接的描述符直接设置为非阻塞和CLOEXEC，省去额外的fcntl
     int Accept()
     {
-        int fd = accept(_sockfd, NULL, NULL);
+        int fd = accept4(_sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (fd < 0)
         {
             if (errno == EAGAIN || errno == EINTR)
             {
                 return -2;
             }
-            DF_ERROR("Accept new fd failed: %s", strerror(errno));
             return -1;
         }
         return fd;
@@ -424,6 +1421,34 @@ public:
         return Recv(buf, len, MSG_DONTWAIT);
     }
 
+    // 非阻塞分散读，一次系统调用把数据依次读进多块内存
+    // 返回值约定同Recv：0表示可以重新接收，-1表示出错或连接断开
+    ssize_t NonBlockRecvv(struct iovec *iov, int iovcnt)
+    {
+        assert(iov != nullptr && iovcnt > 0);
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t ret = recvmsg(_sockfd, &msg, MSG_DONTWAIT);
+        if (ret == 0)
+        {
+            // 对端关闭了连接
+            return -1;
+        }
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return 0;
+            }
+            DF_ERROR("Recvmsg from fd-%d failed: %s", _sockfd, strerror(errno));
+            return -1;
+        }
+        return ret;
+    }
+
     // 发送数据
     ssize_t Send(const void *buf, size_t len, int flags = 0)
     {
@@ -448,10 +1473,59 @@ public:
         return Send(buf, len, MSG_DONTWAIT);
     }
 
+    // 非阻塞聚集写，一次系统调用把多块内存中的数据依次发送出去
+    // more为true表示后面紧跟着还有数据（MSG_MORE），内核先攒着不发小包
+    // 返回值约定同Send：0表示可以重新发送，-1表示出错或连接断开
+    ssize_t NonBlockSendv(const struct iovec *iov, int iovcnt, bool more = false)
+    {
+        assert(iov != nullptr && iovcnt > 0);
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = const_cast<struct iovec *>(iov);
+        msg.msg_iovlen = iovcnt;
+
+        // MSG_NOSIGNAL: 对端已关闭时返回EPIPE，而不是让SIGPIPE杀死进程
+        ssize_t ret = sendmsg(_sockfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return 0;
+            }
+            DF_ERROR("Sendmsg to fd-%d failed: %s", _sockfd, strerror(errno));
+            return -1;
+        }
+        return ret;
+    }
+
+    // 零拷贝发送文件内容（要求套接字为非阻塞），offset为文件内偏移
+    // 返回值约定同Send：0表示可以重新发送，-1表示出错或连接断开
+    ssize_t SendFile(int in_fd, off_t offset, size_t count)
+    {
+        ssize_t ret = sendfile(_sockfd, in_fd, &offset, count);
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return 0;
+            }
+            DF_ERROR("Sendfile to fd-%d failed: %s", _sockfd, strerror(errno));
+            return -1;
+        }
+        if (ret == 0 && count > 0)
+        {
+            // 文件在发送过程中被截断了，剩余内容永远发不出去
+            DF_ERROR("Sendfile to fd-%d failed: unexpected end of file", _sockfd);
+            return -1;
+        }
+        return ret;
+    }
+
     // 创建一个server连接 (listen套接字)
-    bool CreateServer(const uint16_t &port, const std::string &ip = "0.0.0.0")
+    // reuse_port为true时开启SO_REUSEPORT，多个监听套接字可以绑定同一端口，由内核在它们之间分发新连接
+    bool CreateServer(const uint16_t &port, const std::string &ip = "0.0.0.0", bool reuse_port = false, int backlog = DEFAULT_BACKLOG)
     {
-        return Create() && SetNonBlock() && SetAddrReuse() && Bind(ip, port) && Listen();
+        return Create() && SetNonBlock() && SetAddrReuse() && (!reuse_port || SetPortReuse()) && Bind(ip, port) && Listen(backlog);
     }
 
     // 创建一个client连接
@@ -472,70 +1546,275 @@ public:
         return true;
     }
 
-    // 设置套接字为非阻塞
-    bool SetNonBlock()
+    // 设置套接字为端口重用（SO_REUSEPORT，必须在bind之前设置）
+    bool SetPortReuse()
     {
-        int flags = fcntl(_sockfd, F_GETFL, 0);
-        if (fcntl(_sockfd, F_SETFL, flags | O_NONBLOCK) == -1)
+        int optval = 1;
+        if (setsockopt(_sockfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
         {
-            DF_ERROR("fd-%d SetNonBlock", _sockfd);
+            DF_ERROR("fd-%d SetPortReuse: %s", _sockfd, strerror(errno));
             return false;
         }
         return true;
     }
 
-private:
-    int _sockfd;
-};
-
-/*
-
-    Channel事件管理器
-
-*/
-class Poller;
-class EventLoop;
-class Channel
-{
-    using EventCallback = std::function<void()>; // 事件回调函数类型
-public:
-    Channel(int fd, EventLoop *looper) : _fd(fd), _looper(looper) {}
-
-    // EventLoop监控到事件发生后，调用此函数
-    void setREvents(uint32_t revents)
+    // 为SO_REUSEPORT组挂载CBPF分发程序，程序返回值是组内套接字的下标（按bind的先后顺序）
+    bool AttachReusePortCbpf(const std::vector<struct sock_filter> &prog)
     {
-        _revents = revents;
+        struct sock_fprog fprog;
+        fprog.len = prog.size();
+        fprog.filter = const_cast<struct sock_filter *>(prog.data());
+        if (setsockopt(_sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) < 0)
+        {
+            DF_ERROR("fd-%d AttachReusePortCbpf: %s", _sockfd, strerror(errno));
+            return false;
+        }
+        return true;
     }
 
-    int Fd() const
+    // 为SO_REUSEPORT组挂载已加载好的EBPF分发程序（BPF_PROG_TYPE_SOCKET_FILTER）
+    bool AttachReusePortEbpf(int prog_fd)
     {
-        return _fd;
-    }
-
-    uint32_t Events() const
+        if (setsockopt(_sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, &prog_fd, sizeof(prog_fd)) < 0)
+        {
+            DF_ERROR("fd-%d AttachReusePortEbpf: %s", _sockfd, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    // 按收到SYN的CPU分发的CBPF程序：下标 = CPU编号 % group_size
+    // 第i个监听套接字所在的线程绑定在第i个CPU上时，连接就落在处理其软中断的CPU上
+    static std::vector<struct sock_filter> CpuSteeringProgram(uint32_t group_size)
+    {
+        assert(group_size > 0);
+        return std::vector<struct sock_filter>{
+            {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)}, // A = 当前CPU编号
+            {BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size},                       // A = A % group_size
+            {BPF_RET | BPF_A, 0, 0, 0},                                          // return A
+        };
+    }
+
+    // 设置套接字的忙轮询时长（SO_BUSY_POLL，微秒），阻塞读和poll时先在网卡队列上轮询
+    // 监听套接字上设置后，accept得到的连接套接字继承这个值；超过系统默认值需要CAP_NET_ADMIN
+    bool SetBusyPoll(int usec)
+    {
+        if (setsockopt(_sockfd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+        {
+            DF_WARN("fd-%d SetBusyPoll: %s", _sockfd, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    // 关闭Nagle算法（TCP_NODELAY）
+    bool SetNoDelay(bool on)
+    {
+        return SetOption(IPPROTO_TCP, TCP_NODELAY, on ? 1 : 0, "TCP_NODELAY");
+    }
+    // 设置发送、接收缓冲区大小（内核实际使用的是设置值的两倍）
+    bool SetSendBuffer(int bytes)
+    {
+        return SetOption(SOL_SOCKET, SO_SNDBUF, bytes, "SO_SNDBUF");
+    }
+    bool SetRecvBuffer(int bytes)
+    {
+        return SetOption(SOL_SOCKET, SO_RCVBUF, bytes, "SO_RCVBUF");
+    }
+    // 监听套接字：连接收到数据后才放进全连接队列，省掉一次只有连接建立、没有请求的唤醒
+    bool SetDeferAccept(int sec)
+    {
+        return SetOption(IPPROTO_TCP, TCP_DEFER_ACCEPT, sec, "TCP_DEFER_ACCEPT");
+    }
+    // 监听套接字：开启TCP Fast Open（还需要sysctl net.ipv4.tcp_fastopen开启服务端）
+    bool SetFastOpen(int queue_len)
+    {
+        return SetOption(IPPROTO_TCP, TCP_FASTOPEN, queue_len, "TCP_FASTOPEN");
+    }
+    // 立即回复ACK：内核在之后的某些时机会退回延迟确认，需要在每次读之后重新设置
+    bool SetQuickAck(bool on)
+    {
+        return SetOption(IPPROTO_TCP, TCP_QUICKACK, on ? 1 : 0, "TCP_QUICKACK");
+    }
+    // 发出的数据超过ms毫秒没有被确认，就断开连接（对端掉线时不必等到重传超时）
+    bool SetUserTimeout(int ms)
+    {
+        return SetOption(IPPROTO_TCP, TCP_USER_TIMEOUT, ms, "TCP_USER_TIMEOUT");
+    }
+    // 开启保活，interval、count为0时使用系统默认值
+    bool SetKeepAlive(int idle_sec, int interval_sec, int count)
+    {
+        bool ok = SetOption(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE") && SetOption(IPPROTO_TCP, TCP_KEEPIDLE, idle_sec, "TCP_KEEPIDLE");
+        if (ok && interval_sec > 0)
+        {
+            ok = SetOption(IPPROTO_TCP, TCP_KEEPINTVL, interval_sec, "TCP_KEEPINTVL");
+        }
+        if (ok && count > 0)
+        {
+            ok = SetOption(IPPROTO_TCP, TCP_KEEPCNT, count, "TCP_KEEPCNT");
+        }
+        return ok;
+    }
+    // 把调优参数设置到监听套接字上（listen之后、开始获取连接之前），返回是否全部设置成功
+    // 单个选项失败（如内核不支持、权限不足）只打印警告，不影响其它选项
+    bool ApplyListenOptions(const SocketOptions &opts)
+    {
+        bool ok = true;
+        if (opts.no_delay)
+        {
+            ok &= SetNoDelay(true);
+        }
+        if (opts.send_buffer > 0)
+        {
+            ok &= SetSendBuffer(opts.send_buffer);
+        }
+        if (opts.recv_buffer > 0)
+        {
+            ok &= SetRecvBuffer(opts.recv_buffer);
+        }
+        if (opts.defer_accept_sec > 0)
+        {
+            ok &= SetDeferAccept(opts.defer_accept_sec);
+        }
+        if (opts.fastopen_queue > 0)
+        {
+            ok &= SetFastOpen(opts.fastopen_queue);
+        }
+        if (opts.busy_poll_us > 0)
+        {
+            ok &= SetBusyPoll(opts.busy_poll_us);
+        }
+        if (opts.user_timeout_ms > 0)
+        {
+            ok &= SetUserTimeout(opts.user_timeout_ms);
+        }
+        if (opts.keepalive_idle_sec > 0)
+        {
+            ok &= SetKeepAlive(opts.keepalive_idle_sec, opts.keepalive_interval_sec, opts.keepalive_count);
+        }
+        return ok;
+    }
+
+    // 设置套接字为非阻塞
+    bool SetNonBlock()
+    {
+        int flags = fcntl(_sockfd, F_GETFL, 0);
+        if (fcntl(_sockfd, F_SETFL, flags | O_NONBLOCK) == -1)
+        {
+            DF_ERROR("fd-%d SetNonBlock", _sockfd);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool SetOption(int level, int name, int value, const char *what)
+    {
+        if (setsockopt(_sockfd, level, name, &value, sizeof(value)) < 0)
+        {
+            DF_WARN("fd-%d set %s=%d: %s", _sockfd, what, value, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+private:
+    int _sockfd;
+};
+
+/*
+
+    Channel事件管理器
+
+*/
+class Poller;
+class EventLoop;
+// 一组事件处理函数，同一类所有者（如所有Connection）的Channel共用一份静态表，Channel只保存表指针和所有者指针
+struct ChannelHandlers
+{
+    using Handler = void (*)(void *owner);
+    Handler read;  // 可读事件
+    Handler write; // 可写事件
+    Handler error; // 错误事件
+    Handler close; // 连接断开事件
+    Handler any;   // 任意事件
+
+    // 把所有者的成员函数适配成处理函数，如 &ChannelHandlers::call<Connection, &Connection::handleRead>
+    template <class T, void (T::*Method)()>
+    static void call(void *owner)
+    {
+        (static_cast<T *>(owner)->*Method)();
+    }
+};
+
+class Channel
+{
+    using EventCallback = InplaceFunction<void()>; // 事件回调函数类型（内联存储，设置和调用都不分配内存）
+
+    // 单独设置的回调函数（监听套接字、eventfd等少量Channel使用，第一次设置时才创建）
+    struct Callbacks
+    {
+        EventCallback read;
+        EventCallback write;
+        EventCallback error;
+        EventCallback close;
+        EventCallback any;
+    };
+
+public:
+    Channel(int fd, EventLoop *looper) : _fd(fd), _events(0), _revents(0), _edge_triggered(false), _looper(looper) {}
+
+    // EventLoop监控到事件发生后，调用此函数
+    void setREvents(uint32_t revents)
+    {
+        _revents = revents;
+    }
+
+    int Fd() const
+    {
+        return _fd;
+    }
+
+    uint32_t Events() const
     {
-        return _events;
+        return _edge_triggered ? (_events | EPOLLET) : _events;
     }
 
-    void setReadCallback(const EventCallback &event_cb)
+    // 使用边缘触发（在启动事件监控之前设置）
+    void enableEdgeTrigger()
     {
-        _read_callback = event_cb;
+        _edge_triggered = true;
     }
-    void setWriteCallback(const EventCallback &event_cb)
+    bool isEdgeTriggered() const
     {
-        _write_callback = event_cb;
+        return _edge_triggered;
     }
-    void setErrorCallback(const EventCallback &event_cb)
+
+    void setReadCallback(EventCallback event_cb)
+    {
+        callbacks().read = std::move(event_cb);
+    }
+    void setWriteCallback(EventCallback event_cb)
+    {
+        callbacks().write = std::move(event_cb);
+    }
+    void setErrorCallback(EventCallback event_cb)
+    {
+        callbacks().error = std::move(event_cb);
+    }
+    void setCloseCallback(EventCallback event_cb)
     {
-        _error_callback = event_cb;
+        callbacks().close = std::move(event_cb);
     }
-    void setCloseCallback(const EventCallback &event_cb)
+    void setAnyCallback(EventCallback event_cb)
     {
-        _close_callback = event_cb;
+        callbacks().any = std::move(event_cb);
     }
-    void setAnyCallback(const EventCallback &event_cb)
+    // 使用共享的事件处理函数表（设置后不再使用单独设置的回调函数），owner作为参数传给处理函数
+    void setHandlers(const ChannelHandlers *handlers, void *owner)
     {
-        _any_callback = event_cb;
+        _handlers = handlers;
+        _owner = owner;
     }
 
     // 启动可读事件监控
@@ -589,57 +1868,74 @@ public:
     // 如果在回调中关闭了连接，后续事件处理可能会因为资源无效而出问题
     void handleEvent()
     {
+        bool handled = false;
         // 可读事件发生 （正常地收到可读数据 or 对端关闭写端或连接时 or 收到带外数据）
         if ((_revents & EPOLLIN) || (_revents & EPOLLRDHUP) || (_revents & EPOLLPRI))
         {
-            if (_read_callback)
-            {
-                _read_callback();
-            }
+            dispatch(&ChannelHandlers::read, &Callbacks::read);
+            handled = true;
         }
-        // 可写事件发生（写数据时可能发现对端关闭了连接，发不过去，此时本地也要关闭连接，因此可能会导致连接关闭）
-        else if (_revents & EPOLLOUT)
+        // 可写事件发生，与可读事件在同一次唤醒中一起处理（边缘触发下如果漏掉，就不会再通知了）
+        // （写数据时可能发现对端关闭了连接，发不过去，此时本地也要关闭连接，因此可能会导致连接关闭，但连接释放是放到任务队列中延后执行的）
+        if (_revents & EPOLLOUT)
         {
-            if (_write_callback)
-            {
-                _write_callback();
-            }
+            dispatch(&ChannelHandlers::write, &Callbacks::write);
+            handled = true;
         }
-        // 有可能导致连接关闭的事件处理，一次只执行一个
-        // 错误事件发生
-        else if (_revents & EPOLLERR)
+        // 有可能导致连接关闭的事件处理，一次只执行一个，读写回调中已经能发现并处理连接关闭
+        if (!handled)
         {
-            if (_error_callback)
+            // 错误事件发生
+            if (_revents & EPOLLERR)
             {
-                _error_callback();
+                dispatch(&ChannelHandlers::error, &Callbacks::error);
             }
-        }
-        // 关闭连接事件发生
-        else if (_revents & EPOLLHUP)
-        {
-            if (_close_callback)
+            // 关闭连接事件发生
+            else if (_revents & EPOLLHUP)
             {
-                _close_callback();
+                dispatch(&ChannelHandlers::close, &Callbacks::close);
             }
         }
         // 任意事件发生
         // （由于上面的回调中，可能进行的“连接释放”操作并不立即处理，而是放在任务队列中处理，因此可以最后再进行any回调刷新活跃度）
-        if (_any_callback)
+        dispatch(&ChannelHandlers::any, &Callbacks::any);
+    }
+
+private:
+    Callbacks &callbacks()
+    {
+        if (!_callbacks)
+        {
+            _callbacks = std::make_unique<Callbacks>();
+        }
+        return *_callbacks;
+    }
+
+    // 调用一种事件的处理函数：优先使用共享表，否则使用单独设置的回调函数
+    void dispatch(ChannelHandlers::Handler ChannelHandlers::*handler, EventCallback Callbacks::*callback)
+    {
+        if (_handlers)
+        {
+            if (_handlers->*handler)
+            {
+                (_handlers->*handler)(_owner);
+            }
+        }
+        else if (_callbacks && (*_callbacks).*callback)
         {
-            _any_callback();
+            ((*_callbacks).*callback)();
         }
     }
 
 private:
-    int _fd;           // 管理的描述符
-    uint32_t _events;  // 描述符所关心的事件
-    uint32_t _revents; // 当前描述符触发的事件
+    int _fd;              // 管理的描述符
+    uint32_t _events;     // 描述符所关心的事件
+    uint32_t _revents;    // 当前描述符触发的事件
+    bool _edge_triggered; // 是否使用边缘触发
 
-    EventCallback _read_callback;
-    EventCallback _write_callback;
-    EventCallback _error_callback;
-    EventCallback _close_callback;
-    EventCallback _any_callback;
+    const ChannelHandlers *_handlers = nullptr; // 共享的事件处理函数表
+    void *_owner = nullptr;                     // 事件处理函数的所有者
+    std::unique_ptr<Callbacks> _callbacks;      // 单独设置的回调函数
 
     EventLoop *_looper = nullptr; // 事件监控器
 };
@@ -649,13 +1945,46 @@ private:
     Poller: 事件监控器
 
 */
+// 事件监控后端（TcpServer构造时选择）
+typedef enum
+{
+    EPOLL_BACKEND,   // epoll（默认）
+    IO_URING_BACKEND // io_uring（内核不支持时自动退回epoll）
+} PollerBackend;
+
+class UringPoller;
+
 class Poller
+{
+public:
+    virtual ~Poller() {}
+    // 添加或修改监控事件
+    virtual bool updateEvent(Channel *channel) = 0;
+    // 移除监控事件
+    virtual bool removeEvent(Channel *channel) = 0;
+    // 开始监控，返回活跃Channel
+    // timeout为-1时阻塞到有事件发生，为0时只检查已就绪的事件、立即返回（用于忙轮询）
+    virtual void poll(std::vector<Channel *> &actives, int timeout = -1) = 0;
+    // 完成驱动模式的io_uring监控器（连接收发、新连接获取、定时器直接提交为io_uring请求），不支持时返回nullptr
+    virtual UringPoller *uring() { return nullptr; }
+
+    // 按后端类型创建事件监控器
+    static std::unique_ptr<Poller> Create(PollerBackend backend);
+};
+
+class EpollPoller : public Poller
 {
     const static size_t MAX_EVENTS = 4096;
-    const static int WAIT_TIMEOUT = -1;
+
+    // 以fd为下标的channel表项
+    struct Slot
+    {
+        Channel *channel = nullptr; // 对应的channel（nullptr表示未监控）
+        uint32_t gen = 0;           // 代数，每次移除监控后增加
+    };
 
 public:
-    Poller()
+    EpollPoller()
     {
         _epfd = epoll_create(MAX_EVENTS);
         if (_epfd < 0)
@@ -664,27 +1993,32 @@ public:
             abort();
         }
     }
-    ~Poller()
+    ~EpollPoller()
     {
         close(_epfd);
     }
     // 添加或修改监控事件
-    bool updateEvent(Channel *channel)
+    bool updateEvent(Channel *channel) override
     {
         assert(channel);
+        int fd = channel->Fd();
+        if (fd >= (int)_channels.size())
+        {
+            _channels.resize(std::max((size_t)fd + 1, _channels.size() * 2));
+        }
         // 存在, Modify；不存在, Add
         int op = hasChannel(channel) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-        if (!epollControlHelper(op, channel))
+        if (!epollControlHelper(op, channel, _channels[fd].gen))
         {
             return false;
         }
         // 修改描述符与channel的映射关系
-        _fdToChannel[channel->Fd()] = channel;
+        _channels[fd].channel = channel;
         return true;
     }
 
     // 移除监控事件
-    bool removeEvent(Channel *channel)
+    bool removeEvent(Channel *channel) override
     {
         assert(channel);
         int fd = channel->Fd();
@@ -694,20 +2028,22 @@ public:
             return true;
         }
         // 1.从epoll红黑树中删除
-        if (!epollControlHelper(EPOLL_CTL_DEL, channel))
+        if (!epollControlHelper(EPOLL_CTL_DEL, channel, _channels[fd].gen))
         {
             return false;
         }
-        // 2.从哈希映射中删除
-        _fdToChannel.erase(fd);
+        // 2.从channel表中删除，代数增加，之后收到的旧事件都会被丢弃
+        _channels[fd].channel = nullptr;
+        _channels[fd].gen++;
         return true;
     }
 
-    // 开始监控，返回活跃Channel
-    void poll(std::vector<Channel *> &actives)
+    // 开始监控，返回活跃Channel（actives由调用者复用，只清空不释放）
+    void poll(std::vector<Channel *> &actives, int timeout = -1) override
     {
+        actives.clear();
         // 等待epoll事件发生
-        int nfds = epoll_wait(_epfd, _events, MAX_EVENTS, WAIT_TIMEOUT);
+        int nfds = epoll_wait(_epfd, _events, MAX_EVENTS, timeout);
         if (nfds < 0)
         {
             if (errno == EINTR)
@@ -718,27 +2054,31 @@ public:
             abort();
         }
         // 记录并返回活跃的Channel
-        actives.clear();
-        actives.resize(nfds);
         for (int i = 0; i < nfds; i++)
         {
-            auto it = _fdToChannel.find(_events[i].data.fd);
-            assert(it != _fdToChannel.end());
-
-            // 添加actives
-            actives[i] = it->second;
+            // data中保存的是 代数<<32 | fd，直接下标访问channel表
+            uint64_t data = _events[i].data.u64;
+            int fd = (int)(data & 0xffffffff);
+            uint32_t gen = (uint32_t)(data >> 32);
+            Slot &slot = _channels[fd];
+            if (slot.channel == nullptr || slot.gen != gen)
+            {
+                // 已移除监控的旧事件（如描述符关闭前未移除、又有同号描述符加入）
+                continue;
+            }
             // 设置Channel的就绪事件
-            actives[i]->setREvents(_events[i].events);
+            slot.channel->setREvents(_events[i].events);
+            actives.push_back(slot.channel);
         }
     }
 
 private:
-    bool epollControlHelper(int op, Channel *channel)
+    bool epollControlHelper(int op, Channel *channel, uint32_t gen)
     {
         int fd = channel->Fd();
         struct epoll_event event;
         event.events = channel->Events();
-        event.data.fd = fd;
+        event.data.u64 = ((uint64_t)gen << 32) | (uint32_t)fd;
 
         int ret = epoll_ctl(_epfd, op, fd, &event);
         if (ret < 0)
@@ -751,794 +2091,3612 @@ private:
 
     bool hasChannel(const Channel *channel)
     {
-        return _fdToChannel.find(channel->Fd()) != _fdToChannel.end();
+        int fd = channel->Fd();
+        return fd < (int)_channels.size() && _channels[fd].channel != nullptr;
     }
 
 private:
-    int _epfd;                                       // epoll操作句柄
-    struct epoll_event _events[MAX_EVENTS];          // 保存内核监控到的活跃事件
-    std::unordered_map<int, Channel *> _fdToChannel; // 描述符fd和channel的映射关系
+    int _epfd;                              // epoll操作句柄
+    struct epoll_event _events[MAX_EVENTS]; // 保存内核监控到的活跃事件
+    std::vector<Slot> _channels;            // 以fd为下标的channel表（替代哈希映射）
 };
 
 /*
 
-    Timer：定时器模块
+    UringPoller: 基于io_uring的事件监控器
+
+    - 每个Channel对应一个IORING_OP_POLL_ADD请求：水平触发的Channel使用单次poll，触发后在下一轮监控前重新提交；
+      边缘触发的Channel使用多次触发的poll（IORING_POLL_ADD_MULTI），和EPOLLET一样只在状态变化时通知
+    - 事件的添加、修改、删除只写入提交队列，和等待完成事件一起由一次io_uring_enter提交，不再每次变化都调用epoll_ctl
+    - 完成事件的user_data由 代数<<32 | fd 组成，描述符被移除或修改监控后代数增加，残留的旧完成事件直接丢弃
+    - 完成驱动模式（内核支持提供缓冲区环和多次触发的recv、accept时开启）：连接的收发、新连接的获取、定时器不再等就绪事件，
+      而是直接提交为io_uring请求（UringRequest），由内核完成IO后交付结果：
+      多次触发的accept每来一个新连接产生一个完成事件；多次触发的recv每到一段数据产生一个完成事件，
+      数据在内核从提供缓冲区环中选取的缓冲区里，拷贝进连接的读缓冲区后立即归还；发送用sendmsg，套接字可写时由内核完成；
+      定时器是一个绝对时间的timeout请求，需要提前唤醒时原地更新
+    - 请求的完成事件先收集起来，由内部的一个Channel在事件处理阶段统一分发，和其它Channel的事件一样参与忙轮询的统计
 
 */
-class TimerTask
+// io_uring请求（完成驱动模式）：user_data指向请求对象，完成事件在EventLoop线程中交给处理函数
+// 请求对象由提交者持有；提交者要在请求结束前释放（如连接关闭）时，调用UringPoller::releaseRequest转交，收到最后一个完成事件后由UringPoller删除
+struct UringRequest
 {
-public:
-    using Task = std::function<void()>;
-    using Release = std::function<void()>;
+    // 完成事件处理函数：res为操作结果（失败为-errno），data/len为接收到的数据（只有从提供缓冲区接收时有），more表示请求还会继续产生完成事件
+    using Handler = void (*)(void *owner, int res, const char *data, size_t len, bool more);
 
-    TimerTask(int id, int timeout, Task cb)
-        : _id(id), _timeout(timeout), _callback(cb), _cancelled(false) {}
+    UringRequest(Handler h, void *o) : handler(h), owner(o) {}
+    virtual ~UringRequest() {}
 
-    ~TimerTask()
-    {
-        if (!_cancelled)
-        {
-            // 如果没有被取消，析构时执行任务
-            _callback();
-        }
-        // 不管有没有被取消，该定时器任务都要释放，以防后续访问到空指针
-        _release();
-    }
-    void setRelease(const Release &release)
-    {
-        _release = release;
-    }
-    int timeout()
-    {
-        return _timeout;
-    }
-    void cancel()
+    // 把所有者的成员函数适配成处理函数，如 &UringRequest::call<Connection, &Connection::onRecvComplete>
+    template <class T, void (T::*Method)(int, const char *, size_t, bool)>
+    static void call(void *owner, int res, const char *data, size_t len, bool more)
     {
-        _cancelled = true;
+        (static_cast<T *>(owner)->*Method)(res, data, len, more);
     }
 
-private:
-    int _id;          // 任务编号
-    int _timeout;     // 定时任务的超时时间
-    Task _callback;   // 任务执行的回调函数
-    Release _release; // 释放TimerWheel中的定时任务
-    bool _cancelled;  // 任务是否被取消
+    Handler handler;       // 完成事件处理函数
+    void *owner;           // 处理函数的所有者
+    uint8_t opcode = 0;    // 最近提交的操作（IORING_OP_*）
+    bool inflight = false; // 已提交、还没有收到最后一个完成事件
+    bool orphaned = false; // 提交者已释放，收到最后一个完成事件后删除
 };
-class TimerWheel
-{
-    static const size_t MAX_TIMEOUT = 60;
-    using TimerPtr = std::shared_ptr<TimerTask>;
-    using TimerWeak = std::weak_ptr<TimerTask>;
 
-public:
-    TimerWheel(EventLoop *looper)
-        : _wheel(MAX_TIMEOUT), _tick(0), _looper(looper), _timerfd(createTimerFd()), _timer_channel(std::make_unique<Channel>(_timerfd, _looper))
-    {
-        // 为定时器设置到期任务回调函数
-        _timer_channel->setReadCallback(std::bind(&TimerWheel::onTime, this));
-        // 启动timerfd的读事件监控
-        _timer_channel->enableRead();
-    };
+// 发送请求：sendmsg的消息头和iovec在提交给内核之前要保持有效，发送中的数据块由请求持有，连接先关闭也不会失效
+struct UringSendRequest : public UringRequest
+{
+    static const int MAX_IOV = 64; // 一次sendmsg最多的分段数
 
-    // 创建一个定时任务
-    void addTimer(int id, int timeout, const TimerTask::Task &cb);
-    // 重置一个定时任务
-    void resetTimer(int id);
-    // 取消一个定时任务
-    void cancelTimer(int id);
+    using UringRequest::UringRequest;
 
-    // 运行时间轮一次，即执行秒针指向位置的所有到期任务，随后指针向后偏移一位
-    void runTimerTask()
-    {
-        // 移动秒针
-        _tick++;
-        _tick %= MAX_TIMEOUT;
+    struct msghdr msg;
+    struct iovec iov[MAX_IOV];
+    std::vector<OutputQueue::Block> pinned; // 发送中的内存分段
+};
 
-        // 清空当前秒针位置的数组，释放其中所有任务的shared_ptr
-        _wheel[_tick].clear();
-    }
+class UringPoller : public Poller
+{
+    const static unsigned SQ_ENTRIES = 1024;            // 提交队列长度
+    const static unsigned CQ_ENTRIES = 8192;            // 完成队列长度
+    const static uint64_t IGNORE_DATA = UINT64_MAX;     // 不需要处理的完成事件（如删除poll请求自身的完成事件）
+    const static uint64_t REQUEST_TAG = 1ull << 63;     // user_data最高位为1表示是UringRequest（用户态指针不会用到最高位）
+    const static unsigned PBUF_COUNT = 256;             // 提供缓冲区个数（2的幂）
+    const static size_t PBUF_SIZE = 8192;               // 每个提供缓冲区的大小
+    const static uint16_t PBUF_GROUP = 0;               // 提供缓冲区环的组号
+
+    // 收集到的请求完成事件
+    struct Completion
+    {
+        UringRequest *req;
+        int res;
+        uint32_t flags;
+    };
 
-    // 判断定时任务是否存在（存在线程安全问题，只能在EventLoop当前线程调用）
-    bool hasTimer(int id)
+    struct Slot
     {
-        return _idToTimer.find(id) != _idToTimer.end();
-    }
+        Channel *channel = nullptr; // 对应的channel（nullptr表示未监控）
+        uint32_t gen = 0;           // 代数，每次撤销poll请求后增加
+        uint32_t armed_events = 0;  // 已提交的poll请求所监控的事件
+        uint32_t revents = 0;       // 本轮收集到的就绪事件
+        uint64_t round = 0;         // 最近一次加入actives的轮次
+        bool armed = false;         // 是否有生效中的poll请求
+        bool dirty = false;         // 是否在待提交列表中
+    };
 
-private:
-    void addTimerInLoop(int id, int timeout, const TimerTask::Task &cb)
+public:
+    UringPoller() {}
+    ~UringPoller()
     {
-        if (hasTimer(id))
+        if (_sqes)
         {
-            return;
+            munmap(_sqes, _sqes_size);
         }
-        // 新建一个TimerTask
-        TimerTask *tt = new TimerTask(id, timeout, cb);
-        tt->setRelease(std::bind(&TimerWheel::removeTimer, this, id));
-
-        // shared_ptr<TimerTask> 存入时间轮
-        TimerPtr ptr(tt); // ptr出了当前作用域会销毁，不影响_wheel中shared_ptr的引用计数
-        int pos = (_tick + timeout) % MAX_TIMEOUT;
-        _wheel[pos].emplace_back(ptr);
-
-        // weak_ptr<TimerTask> 存入哈希表，作为shared_ptr的副本，后续用这个副本可以获取一个新的shared_ptr
-        _idToTimer[id] = TimerWeak(ptr);
-
-        // !!警告!!
-        // 如果直接使用原始资源的指针创建shared_ptr
-        // 那每次都是建立一个新的shared_ptr，创建新的计数器，并没有实现计数器的共享
-        // 使用weak_ptr解决，weak_ptr.lock()获取的shared_ptr，会增加引用计数
-        //  _wheel[pos].push_back(TimerPtr(tt));
-    }
-    void resetTimerInLoop(int id)
-    {
-        if (!hasTimer(id))
+        if (_cq_ring && _cq_ring != _sq_ring)
         {
-            // id不存在，无法重置
-            return;
+            munmap(_cq_ring, _cq_ring_size);
         }
-
-        // 根据id所指的weak_ptr，获取一个新的shared_ptr
-        TimerPtr ptr = _idToTimer[id].lock();
-        assert(ptr != nullptr);
-
-        // 新的shared_ptr 存入时间轮
-        int pos = (_tick + ptr->timeout()) % MAX_TIMEOUT;
-        _wheel[pos].push_back(ptr); // 避免push_back增加引用计数?不用，栈变量ptr释放，引用计数--
-    }
-    void cancelTimerInloop(int id)
-    {
-        if (!hasTimer(id))
+        if (_sq_ring)
         {
-            return;
+            munmap(_sq_ring, _sq_ring_size);
         }
-        TimerPtr ptr = _idToTimer[id].lock();
-        // DF_DEBUG("Timer %d is cancelled", id);
-        if (ptr)
+        if (_ring_fd >= 0)
         {
-            ptr->cancel();
+            close(_ring_fd);
         }
-    }
-    // 清除定时任务
-    void removeTimer(int id)
-    {
-        if (!hasTimer(id))
+        // io_uring实例关闭后，内核不再引用提供缓冲区和请求中的数据
+        if (_pbufs)
         {
-            return;
+            munmap(_pbufs, PBUF_COUNT * PBUF_SIZE);
+        }
+        if (_pbuf_ring)
+        {
+            munmap(_pbuf_ring, PBUF_COUNT * sizeof(struct io_uring_buf));
+        }
+        for (UringRequest *req : _orphans)
+        {
+            delete req;
         }
-        // DF_DEBUG("Timer %d is removed", id);
-        _idToTimer.erase(id);
     }
 
-    // 创建一个timerfd
-    static int createTimerFd()
+    // 创建io_uring实例并映射提交/完成队列，失败返回false（由调用者退回epoll）
+    bool init()
     {
-        // 创建 timerfd
-        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
-        if (tfd == -1)
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = CQ_ENTRIES;
+        _ring_fd = (int)syscall(__NR_io_uring_setup, SQ_ENTRIES, &params);
+        if (_ring_fd < 0)
         {
-            DF_ERROR("Timerfd create failed");
-            abort();
+            DF_ERROR("Io_uring setup failed, %s", strerror(errno));
+            return false;
         }
 
-        // 设置定时器, 每隔 1 秒，超时一次
-        struct itimerspec its;
-        its.it_value.tv_sec = 1; // 第一次超时的时间：1 秒后
-        its.it_value.tv_nsec = 0;
-        its.it_interval.tv_sec = 1; // 往后间隔时间：1 秒
-        its.it_interval.tv_nsec = 0;
+        _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+        }
+        _sq_ring = mapRing(_sq_ring_size, IORING_OFF_SQ_RING);
+        _cq_ring = single_mmap ? _sq_ring : mapRing(_cq_ring_size, IORING_OFF_CQ_RING);
+        _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = (struct io_uring_sqe *)mapRing(_sqes_size, IORING_OFF_SQES);
+        if (!_sq_ring || !_cq_ring || !_sqes)
+        {
+            DF_ERROR("Io_uring mmap failed, %s", strerror(errno));
+            return false;
+        }
 
-        if (timerfd_settime(tfd, 0, &its, NULL) == -1)
+        char *sq = (char *)_sq_ring;
+        _sq_head = (unsigned *)(sq + params.sq_off.head);
+        _sq_tail = (unsigned *)(sq + params.sq_off.tail);
+        _sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+        _sq_array = (unsigned *)(sq + params.sq_off.array);
+        _sq_entries = params.sq_entries;
+        _sq_local_tail = *_sq_tail;
+
+        char *cq = (char *)_cq_ring;
+        _cq_head = (unsigned *)(cq + params.cq_off.head);
+        _cq_tail = (unsigned *)(cq + params.cq_off.tail);
+        _cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+        _cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        // 完成驱动模式不可用时，只用poll请求监控就绪事件
+        _completion_mode = supportsMultishot() && setupBufferRing();
+        if (!_completion_mode)
         {
-            DF_ERROR("Timerfd set time failed");
-            abort();
+            DF_WARN("Io_uring multishot recv/accept unavailable, use poll requests only");
+            return true;
         }
-        return tfd;
+        _completion_channel = std::make_unique<Channel>(_ring_fd, nullptr);
+        _completion_channel->setReadCallback(std::bind(&UringPoller::dispatchCompletions, this));
+        return true;
     }
 
-    // 读取清空timerfd的数据
-    int readTimerFd()
+    UringPoller *uring() override
     {
-        uint64_t times;
-        ssize_t ret = read(_timerfd, &times, sizeof(uint64_t));
-        if (ret < 0)
+        return _completion_mode ? this : nullptr;
+    }
+
+    // 添加或修改监控事件（只记录，下一次poll时统一提交）
+    bool updateEvent(Channel *channel) override
+    {
+        assert(channel);
+        int fd = channel->Fd();
+        Slot &slot = getSlot(fd);
+        slot.channel = channel;
+        if (slot.armed)
         {
-            if (errno == EINTR || errno == EAGAIN)
+            if (slot.armed_events == channel->Events())
             {
-                return times;
+                // 监控事件没有变化，已提交的poll请求继续有效
+                return true;
             }
-            DF_ERROR("Timerfd read failed");
-            return -1;
+            disarm(fd, slot);
         }
-        return times;
+        markDirty(fd);
+        return true;
     }
 
-    // 定时器超时处理的回调函数
-    void onTime()
+    // 移除监控事件
+    bool removeEvent(Channel *channel) override
     {
-        // 处理timerfd的读事件，把数据读掉，以防一次超时多次处理
-        int times = readTimerFd();
-        // 超时多少次，就运行多少次时间轮
-        for (int i = 0; i < times; i++)
+        assert(channel);
+        int fd = channel->Fd();
+        if (fd >= (int)_slots.size() || _slots[fd].channel == nullptr)
         {
-            runTimerTask();
+            // 并没有对此fd进行监控，不用移除
+            return true;
         }
+        Slot &slot = _slots[fd];
+        disarm(fd, slot);
+        slot.channel = nullptr;
+        return true;
     }
 
-private:
-    std::vector<std::vector<TimerPtr>> _wheel;     // 存储定时任务的二维数组
-    std::unordered_map<int, TimerWeak> _idToTimer; // 保存定时任务的哈希表
-    int _tick;                                     // 秒针
-
-    EventLoop *_looper;                      // 绑定的event loop
-    int _timerfd;                            // 用于超时事件监控
-    std::unique_ptr<Channel> _timer_channel; // timerfd的channel
-};
+    // 开始监控，返回活跃Channel（timeout只区分0和阻塞）
+    void poll(std::vector<Channel *> &actives, int timeout = -1) override
+    {
+        // 1.为本轮新增、修改、单次poll已触发的描述符提交poll请求
+        for (int fd : _dirty)
+        {
+            Slot &slot = _slots[fd];
+            slot.dirty = false;
+            if (slot.channel && !slot.armed)
+            {
+                arm(fd, slot);
+            }
+        }
+        _dirty.clear();
 
-/*
+        // 2.提交所有请求，并等待至少一个完成事件（被信号打断时，收集已有的完成事件即可）
+        //   不阻塞时只提交请求，完成队列在共享内存中，没有要提交的请求时不需要系统调用
+        enter(timeout == 0 ? 0 : 1);
 
-    EventLoop：事件循环
+        // 3.收集完成事件，同一个描述符的多个事件合并
+        actives.clear();
+        _round++;
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            onCompletion(_cqes[head & _cq_mask], actives);
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
 
-*/
-class EventLoop
-{
-    using Task = std::function<void()>;
+        // 设置Channel的就绪事件
+        for (auto &channel : actives)
+        {
+            channel->setREvents(_slots[channel->Fd()].revents);
+        }
+        // 请求的完成事件由内部Channel统一分发
+        if (!_completions.empty())
+        {
+            _completion_channel->setREvents(EPOLLIN);
+            actives.push_back(_completion_channel.get());
+        }
+    }
 
-public:
-    EventLoop()
-        : _eventfd(createEventFd()), _event_channel(std::make_unique<Channel>(_eventfd, this)), _thread_id(std::this_thread::get_id()), _timer_wheel(this)
+    // 以下为完成驱动模式的请求，只能在EventLoop线程中调用，和poll请求一样在下一次poll时统一提交
+
+    // 多次触发的accept：每来一个新连接产生一个完成事件（res为新连接的描述符，非阻塞）
+    void submitAccept(UringRequest *req, int listen_fd)
     {
-        // 给eventfd添加读事件的回调函数
-        _event_channel->setReadCallback(std::bind(&EventLoop::readEventFd, this));
-        // 开启eventfd读事件监听
-        _event_channel->enableRead();
+        struct io_uring_sqe *sqe = prepareRequest(req, IORING_OP_ACCEPT, listen_fd);
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
     }
-
-    void start()
+    // 多次触发的recv：每到一段数据产生一个完成事件，数据在内核从提供缓冲区环中选取的缓冲区里（缓冲区用完时以-ENOBUFS结束）
+    void submitRecv(UringRequest *req, int fd)
     {
-        while (true)
+        struct io_uring_sqe *sqe = prepareRequest(req, IORING_OP_RECV, fd);
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = PBUF_GROUP;
+    }
+    // 发送req->msg描述的数据，res为发送的字节数（可能只发送了一部分）
+    void submitSendmsg(UringSendRequest *req, int fd, int flags)
+    {
+        struct io_uring_sqe *sqe = prepareRequest(req, IORING_OP_SENDMSG, fd);
+        sqe->addr = (uint64_t)(uintptr_t)&req->msg;
+        sqe->len = 1;
+        sqe->msg_flags = flags;
+    }
+    // 等待描述符可写一次（发送不能交给内核完成的数据时使用，如sendfile）
+    void submitPollOut(UringRequest *req, int fd)
+    {
+        struct io_uring_sqe *sqe = prepareRequest(req, IORING_OP_POLL_ADD, fd);
+        sqe->poll32_events = EPOLLOUT;
+    }
+    // 在单调时钟的ts时刻完成（res为-ETIME），ts在下一次poll之前要保持有效
+    void submitTimeout(UringRequest *req, const struct __kernel_timespec *ts)
+    {
+        struct io_uring_sqe *sqe = prepareRequest(req, IORING_OP_TIMEOUT, -1);
+        sqe->addr = (uint64_t)(uintptr_t)ts;
+        sqe->len = 1;
+        sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    }
+    // 修改进行中的timeout请求的完成时刻（已经到期时修改失败，到期的完成事件照常交付）
+    void updateTimeout(UringRequest *req, const struct __kernel_timespec *ts)
+    {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = requestData(req);
+        sqe->addr2 = (uint64_t)(uintptr_t)ts;
+        sqe->timeout_flags = IORING_TIMEOUT_UPDATE | IORING_TIMEOUT_ABS;
+        sqe->user_data = IGNORE_DATA;
+    }
+    // 撤销进行中的请求，请求随后以-ECANCELED结束（已经结束的不受影响）
+    void cancelRequest(UringRequest *req)
+    {
+        if (!req->inflight)
         {
-            // 1.IO事件监听
-            std::vector<Channel *> actives;
-            _poller.poll(actives);
-
-            // 2.事件处理
-            for (auto &active_channel : actives)
-            {
-                active_channel->handleEvent();
-            }
-
-            // 3.任务执行（其它线程的、延后处理的）
-            runAllTasks();
+            return;
         }
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = req->opcode == IORING_OP_TIMEOUT ? IORING_OP_TIMEOUT_REMOVE : IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = requestData(req);
+        sqe->user_data = IGNORE_DATA;
     }
-
-    // 判断当前线程是否是EventLoop所绑定的线程
-    bool isInLoop()
+    // 提交者释放请求：没有进行中的直接删除，否则撤销，收到最后一个完成事件后再删除
+    void releaseRequest(UringRequest *req)
     {
-        return std::this_thread::get_id() == _thread_id;
+        if (!req->inflight)
+        {
+            delete req;
+            return;
+        }
+        cancelRequest(req);
+        req->orphaned = true;
+        _orphans.insert(req);
+    }
+    // 立即提交已填写的请求（关闭描述符之前调用：还没提交的请求如果等到下一次poll，描述符可能已被新连接复用）
+    void submit()
+    {
+        enter(0);
     }
 
-    void assertInLoop()
+private:
+    void *mapRing(size_t size, off_t offset)
     {
-        assert(isInLoop() == true);
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
     }
 
-    // 在这个EventLoop中执行任务 （其它线程可调用）
-    // EventLoop本线程任务：直接执行
-    // 其它线程任务：压入任务队列
-    void runInLoop(const Task &cb)
+    Slot &getSlot(int fd)
     {
-        if (isInLoop())
+        if (fd >= (int)_slots.size())
         {
-            cb();
-        }
-        else
-        {
-            // DF_DEBUG("有一个其它线程的任务到来，压入任务队列");
-            cacheTask(cb);
+            _slots.resize(std::max((size_t)fd + 1, _slots.size() * 2));
         }
+        return _slots[fd];
     }
 
-    // 将任务暂时缓存到任务队列
-    void cacheTask(const Task &cb)
+    void markDirty(int fd)
     {
+        Slot &slot = _slots[fd];
+        if (!slot.dirty)
         {
-            std::unique_lock<std::mutex> lockguard(_mtx);
-            _tasks.push_back(cb);
+            slot.dirty = true;
+            _dirty.push_back(fd);
         }
-        weakupEventFd();
     }
 
-    // 新增/修改监控事件
-    bool updateEvent(Channel *channel)
+    // poll请求的user_data（代数只取低31位，最高位留给UringRequest）
+    static uint64_t userData(int fd, uint32_t gen)
     {
-        return _poller.updateEvent(channel);
+        return ((uint64_t)(gen & 0x7fffffff) << 32) | (uint32_t)fd;
+    }
+    static uint64_t requestData(UringRequest *req)
+    {
+        return (uint64_t)(uintptr_t)req | REQUEST_TAG;
     }
 
-    // 移除监控事件
-    bool removeEvent(Channel *channel)
+    struct io_uring_sqe *prepareRequest(UringRequest *req, uint8_t opcode, int fd)
     {
-        return _poller.removeEvent(channel);
+        assert(!req->inflight && !req->orphaned);
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = requestData(req);
+        req->opcode = opcode;
+        req->inflight = true;
+        return sqe;
     }
 
-    // 新增定时任务
-    void addTimer(int id, int timeout, TimerTask::Task cb)
+    // 多次触发的recv（6.0）没有单独的特性位，用同一版本加入的IORING_OP_SEND_ZC判断
+    bool supportsMultishot()
     {
-        _timer_wheel.addTimer(id, timeout, cb);
+        const unsigned ops = 256;
+        std::vector<char> buf(sizeof(struct io_uring_probe) + ops * sizeof(struct io_uring_probe_op), 0);
+        struct io_uring_probe *probe = (struct io_uring_probe *)buf.data();
+        if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PROBE, probe, ops) < 0)
+        {
+            return false;
+        }
+        return probe->last_op >= IORING_OP_SEND_ZC && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
     }
-    // 重置定时任务
-    void resetTimer(int id)
+
+    // 注册提供缓冲区环，所有缓冲区先放进环里（缓冲区的内存在内核第一次写入时才实际分配）
+    bool setupBufferRing()
     {
-        _timer_wheel.resetTimer(id);
+        size_t ring_size = PBUF_COUNT * sizeof(struct io_uring_buf);
+        void *ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void *bufs = mmap(nullptr, PBUF_COUNT * PBUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        _pbuf_ring = ring == MAP_FAILED ? nullptr : (struct io_uring_buf *)ring;
+        _pbufs = bufs == MAP_FAILED ? nullptr : (char *)bufs;
+        if (!_pbuf_ring || !_pbufs)
+        {
+            return false;
+        }
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)_pbuf_ring;
+        reg.ring_entries = PBUF_COUNT;
+        reg.bgid = PBUF_GROUP;
+        if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        {
+            return false;
+        }
+        for (unsigned bid = 0; bid < PBUF_COUNT; bid++)
+        {
+            recycleBuffer(bid);
+        }
+        publishBuffers();
+        return true;
     }
-    // 取消一个定时任务
-    void cancelTimer(int id)
+    // 把缓冲区放回环里（publishBuffers之后内核才能看到）
+    void recycleBuffer(uint16_t bid)
     {
-        _timer_wheel.cancelTimer(id);
+        struct io_uring_buf *buf = &_pbuf_ring[_pbuf_tail & (PBUF_COUNT - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(_pbufs + bid * PBUF_SIZE);
+        buf->len = PBUF_SIZE;
+        buf->bid = bid;
+        _pbuf_tail++;
     }
-
-    bool hasTimer(int id)
+    // 队尾与第0项的resv字段重叠（按C++编译时io_uring_buf_ring::bufs的偏移不是0，这里直接按io_uring_buf数组访问）
+    void publishBuffers()
     {
-        return _timer_wheel.hasTimer(id);
+        __atomic_store_n(&_pbuf_ring[0].resv, _pbuf_tail, __ATOMIC_RELEASE);
     }
 
-private:
-    void runAllTasks()
+    // 分发本轮收集到的请求完成事件（内部Channel的读事件处理函数）
+    // 处理函数中可以提交、释放请求；最后一个完成事件先清除inflight再调用处理函数，之后不再访问请求对象
+    void dispatchCompletions()
     {
-        // 取出任务池中的所有任务，执行
-        std::vector<Task> tasks;
+        _dispatching.swap(_completions);
+        for (const Completion &c : _dispatching)
         {
-            std::unique_lock<std::mutex> lockguard(_mtx);
-            if (_tasks.empty())
+            UringRequest *req = c.req;
+            bool more = c.flags & IORING_CQE_F_MORE;
+            const char *data = nullptr;
+            size_t len = 0;
+            int bid = -1;
+            if (c.flags & IORING_CQE_F_BUFFER)
             {
-                return;
+                bid = c.flags >> IORING_CQE_BUFFER_SHIFT;
+                data = _pbufs + bid * PBUF_SIZE;
+                len = c.res > 0 ? c.res : 0;
+            }
+            if (!more)
+            {
+                req->inflight = false;
+            }
+            if (req->orphaned)
+            {
+                // 提交者已经释放：撤销前获取到的新连接直接关闭
+                if (req->opcode == IORING_OP_ACCEPT && c.res >= 0)
+                {
+                    close(c.res);
+                }
+                if (!req->inflight)
+                {
+                    _orphans.erase(req);
+                    delete req;
+                }
+            }
+            else
+            {
+                req->handler(req->owner, c.res, data, len, more);
+            }
+            if (bid >= 0)
+            {
+                recycleBuffer(bid);
             }
-            tasks.swap(_tasks);
         }
-        // 加锁只是把任务队列中的任务拿出来，然后解锁，再执行每个任务，降低锁的力度
-        for (auto &t : tasks)
+        _dispatching.clear();
+        publishBuffers();
+    }
+
+    // 获取一个空闲的提交队列项，队列满时先把已有请求提交给内核
+    struct io_uring_sqe *getSqe()
+    {
+        if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries)
         {
-            t();
+            enter(0);
         }
+        unsigned idx = _sq_local_tail & _sq_mask;
+        _sq_array[idx] = idx;
+        _sq_local_tail++;
+        struct io_uring_sqe *sqe = &_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
     }
 
-    static int createEventFd()
+    // 提交poll请求（poll的事件位与epoll一致，EPOLLET改由多次触发poll实现）
+    void arm(int fd, Slot &slot)
     {
-        int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
-        if (efd < 0)
+        uint32_t events = slot.channel->Events();
+        if ((events & ~EPOLLET) == 0)
         {
-            DF_ERROR("Eventfd create failed");
-            abort();
+            // 不关心任何事件（disableAll）
+            return;
         }
-        return efd;
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = events & ~EPOLLET;
+        sqe->len = (events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+        sqe->user_data = userData(fd, slot.gen);
+        slot.armed = true;
+        slot.armed_events = events;
     }
 
-    void readEventFd()
+    // 撤销poll请求，代数增加，之后到达的旧完成事件都会被丢弃
+    void disarm(int fd, Slot &slot)
     {
-        uint64_t signal = 0;
-        int ret = read(_eventfd, &signal, sizeof(uint64_t));
-        if (ret < 0)
+        if (slot.armed)
+        {
+            struct io_uring_sqe *sqe = getSqe();
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = userData(fd, slot.gen);
+            sqe->user_data = IGNORE_DATA;
+            slot.armed = false;
+        }
+        slot.gen++;
+    }
+
+    void onCompletion(const struct io_uring_cqe &cqe, std::vector<Channel *> &actives)
+    {
+        if (cqe.user_data == IGNORE_DATA)
         {
-            if (errno == EINTR || errno == EAGAIN)
-            {
-                return;
-            }
-            DF_ERROR("Eventfd read failed");
             return;
         }
+        if (cqe.user_data & REQUEST_TAG)
+        {
+            _completions.push_back(Completion{(UringRequest *)(uintptr_t)(cqe.user_data & ~REQUEST_TAG), cqe.res, cqe.flags});
+            return;
+        }
+        int fd = (int)(cqe.user_data & 0xffffffff);
+        if (fd >= (int)_slots.size() || _slots[fd].channel == nullptr || userData(fd, _slots[fd].gen) != cqe.user_data)
+        {
+            // 已撤销的poll请求残留的完成事件
+            return;
+        }
+        Slot &slot = _slots[fd];
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+        {
+            // 单次poll已触发（或多次poll被内核终止），下一轮重新提交
+            slot.armed = false;
+            markDirty(fd);
+        }
+        if (slot.round != _round)
+        {
+            slot.round = _round;
+            slot.revents = 0;
+            actives.push_back(slot.channel);
+        }
+        slot.revents |= (cqe.res < 0) ? EPOLLERR : (uint32_t)cqe.res;
     }
 
-    void weakupEventFd()
+    // 提交请求，min_complete>0时等待完成事件
+    void enter(unsigned min_complete)
     {
-        uint64_t signal = 1;
-        int ret = write(_eventfd, &signal, sizeof(uint64_t));
+        __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (to_submit == 0 && min_complete == 0)
+        {
+            return;
+        }
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int ret = (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, flags, nullptr, 0);
         if (ret < 0)
         {
-            if (errno == EINTR || errno == EAGAIN)
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
             {
                 return;
             }
-            DF_ERROR("Eventfd write failed");
-            return;
+            DF_ERROR("Io_uring enter failed: %s", strerror(errno));
+            abort();
         }
     }
 
 private:
-    std::thread::id _thread_id;              // 事件循环所在线程id
-    Poller _poller;                          // 事件监听器
-    
-    int _eventfd;                            // 用于唤醒IO事件监听阻塞（向eventfd计数器写入，就有了一个读事件，就可以唤醒）
-    std::unique_ptr<Channel> _event_channel; // eventfd对应的channel
-
-    std::vector<Task> _tasks;                // 任务池
-    std::mutex _mtx;                         // 保护任务池
-
-    TimerWheel _timer_wheel;                 // 定时器
+    int _ring_fd = -1; // io_uring实例描述符
+
+    void *_sq_ring = nullptr; // 提交队列映射
+    void *_cq_ring = nullptr; // 完成队列映射（内核支持时与提交队列同一块映射）
+    size_t _sq_ring_size = 0;
+    size_t _cq_ring_size = 0;
+    struct io_uring_sqe *_sqes = nullptr; // 提交队列项数组
+    size_t _sqes_size = 0;
+
+    unsigned *_sq_head = nullptr;
+    unsigned *_sq_tail = nullptr;
+    unsigned *_sq_array = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned _sq_entries = 0;
+    unsigned _sq_local_tail = 0; // 已填写但尚未发布给内核的队尾
+
+    unsigned *_cq_head = nullptr;
+    unsigned *_cq_tail = nullptr;
+    unsigned _cq_mask = 0;
+    struct io_uring_cqe *_cqes = nullptr;
+
+    std::vector<Slot> _slots; // 以fd为下标的监控状态
+    std::vector<int> _dirty;  // 待提交poll请求的描述符
+    uint64_t _round = 0;      // 监控轮次
+
+    bool _completion_mode = false;                    // 是否开启完成驱动模式
+    struct io_uring_buf *_pbuf_ring = nullptr;        // 提供缓冲区环
+    char *_pbufs = nullptr;                           // 提供缓冲区（PBUF_COUNT个，按编号排列）
+    uint16_t _pbuf_tail = 0;                          // 提供缓冲区环的队尾
+    std::vector<Completion> _completions;             // 本轮收集到的请求完成事件
+    std::vector<Completion> _dispatching;             // 正在分发的请求完成事件
+    std::unique_ptr<Channel> _completion_channel;     // 分发请求完成事件的内部Channel
+    std::unordered_set<UringRequest *> _orphans;      // 提交者已释放、还没有结束的请求
 };
 
+std::unique_ptr<Poller> Poller::Create(PollerBackend backend)
+{
+    if (backend == IO_URING_BACKEND)
+    {
+        std::unique_ptr<UringPoller> poller(new UringPoller);
+        if (poller->init())
+        {
+            return poller;
+        }
+        DF_WARN("Io_uring unavailable, fall back to epoll");
+    }
+    return std::unique_ptr<Poller>(new EpollPoller);
+}
+
 /*
 
-    Connection: 通信连接管理
+    Timer：定时器模块
+
+    分层时间轮，毫秒精度：第0层256个槽，每槽1ms；往上4层各64个槽，每槽分别为256ms、16s、17min、18h
+    第0层每转一圈，上一层的一个槽下移（cascade），其中的定时器按真实到期时刻重新放置；超出范围的先放在最高层
+    定时器节点是侵入式的双向链表节点，添加、取消、重置都是O(1)，不需要分配内存
+    timerfd只在有定时器时按下一个需要处理的时刻设置一次，不再每秒固定唤醒
 
 */
-class Connection;
-using PtrConnection = std::shared_ptr<Connection>;
-typedef enum
+// 侵入式双向链表节点（也用作时间轮槽位的链表头）
+struct TimerListHead
 {
-    CLOSED,     // 已关闭
-    CONNECTED,  // 已连接：已完成各种设置，可进行通信
-    CLOSING,    // 关闭中：待关闭状态，缓冲区可能还有数据未处理
-    CONNECTING, // 连接中：待处理
-} ConnStat;
-class Connection : public std::enable_shared_from_this<Connection>
+    TimerListHead *prev = nullptr;
+    TimerListHead *next = nullptr;
+};
+
+// 定时器节点：可以作为成员嵌入到对象中（如连接的空闲超时），也可以由时间轮的节点池提供（runAfter等）
+class TimerNode : private TimerListHead
 {
-private:
-    uint64_t _conn_id;           // 连接的唯一标识ID
-    Socket _socket;              // 连接的套接字
-    ConnStat _status;            // 连接状态
-    Channel _channel;            // 连接事件管理
-    Buffer _in_buffer;           // 读缓冲区
-    Buffer _out_buffer;          // 写缓冲区
-    Any _context;                // 协议上下文
-    EventLoop *_looper;          // 连接所绑定的事件循环
-    bool _enable_inactive_close; // 是否启用连接空闲超时关闭
+public:
+    using Task = InplaceFunction<void()>;
 
-    // using ClosedCallback = std::function<void(Connection*)>;
-    // 防止多线程对连接Connection进行操作时，多次释放导致野指针错误，这里对外提供的接口用shared_ptr智能指针操作连接
+    TimerNode() {}
+    TimerNode(const TimerNode &) = delete;
+    TimerNode &operator=(const TimerNode &) = delete;
 
-    // 外部回调函数
-    using ConnectionCallback = std::function<void(const PtrConnection &)>;
-    using MessageCallback = std::function<void(const PtrConnection &, Buffer &)>;
-    ConnectionCallback _closed_cb;        // 连接关闭回调函数
-    ConnectionCallback _connected_cb;     // 连接建立回调函数
-    ConnectionCallback _any_cb;           // 任意事件回调函数
-    MessageCallback _message_cb;          // 业务处理回调函数
-    ConnectionCallback _server_closed_cb; // 组件内部使用的连接关闭回调函数
+    // 是否在时间轮中等待到期
+    bool linked() const
+    {
+        return next != nullptr;
+    }
 
 private:
-    // 内部channel事件发生的回调函数
-    // 描述符可读事件发生
-    void handleRead()
+    friend class TimerWheel;
+
+    uint64_t _expire = 0;          // 到期时刻（时间轮刻度，毫秒）
+    uint64_t _timeout = 0;         // 超时时长（重置时从当前时刻重新计时）
+    uint64_t _interval = 0;        // 重复间隔（0表示只执行一次）
+    Task _callback;                // 到期回调
+    uint32_t _index = UINT32_MAX;  // 在节点池中的下标（嵌入式节点为UINT32_MAX）
+    uint32_t _gen = 0;             // 代数，节点池回收节点后增加，旧句柄随之失效
+    uint8_t _level = 0;            // 所在的层
+    bool _running = false;         // 回调正在执行
+    bool _cancelled = false;       // 回调执行期间被取消
+};
+
+// 定时器句柄（runAfter/runEvery/runAt返回，用于取消、重置；定时器结束后句柄自动失效）
+class TimerId
+{
+public:
+    TimerId() {}
+    // 是否是一个创建过定时器的句柄（不代表定时器仍未到期）
+    bool valid() const
     {
-        // 1.把socket中的数据读到in_buffer中
-        char buf[65536]{};
-        ssize_t ret = _socket.NonBlockRecv(buf, sizeof(buf));
-        if (ret < 0)
+        return _index != UINT32_MAX;
+    }
+
+private:
+    friend class TimerWheel;
+    TimerId(uint32_t index, uint32_t gen) : _index(index), _gen(gen) {}
+
+    uint32_t _index = UINT32_MAX;
+    uint32_t _gen = 0;
+};
+
+class TimerWheel
+{
+    using Task = TimerNode::Task;
+
+    static const int NEAR_BITS = 8;                              // 第0层槽数的位数
+    static const int LEVEL_BITS = 6;                             // 上层槽数的位数
+    static const int LEVELS = 4;                                 // 上层的层数
+    static const size_t NEAR_SIZE = 1 << NEAR_BITS;              // 第0层槽数
+    static const size_t LEVEL_SIZE = 1 << LEVEL_BITS;            // 上层每层槽数
+    static const uint64_t NEAR_MASK = NEAR_SIZE - 1;             //
+    static const uint64_t LEVEL_MASK = LEVEL_SIZE - 1;           //
+    static const int MAX_BITS = NEAR_BITS + LEVELS * LEVEL_BITS; // 时间轮能表示的范围（2^32 ms，约49天）
+    static const uint64_t NEVER = UINT64_MAX;                    // 唤醒时刻未设置
+
+public:
+    // uring不为空时（io_uring完成驱动模式）用io_uring的timeout请求唤醒，否则用timerfd
+    TimerWheel(EventLoop *looper, UringPoller *uring)
+        : _looper(looper), _base_ms(monotonicMs()), _current(0), _armed_at(NEVER), _count(0), _timerfd(-1), _uring(uring)
+    {
+        initList(&_near[0], NEAR_SIZE);
+        for (int level = 0; level < LEVELS; level++)
         {
-            DF_DEBUG("连接fd: %d 被挂断了, 尝试关闭连接", _socket.Fd());
-            // 读取失败，关闭连接
-            // shutdown();
-            handleClose();
+            initList(&_levels[level][0], LEVEL_SIZE);
+        }
+        if (_uring)
+        {
+            _timeout_req = std::make_unique<UringRequest>(&UringRequest::call<TimerWheel, &TimerWheel::onTimeout>, this);
             return;
         }
-        _in_buffer.write(buf, ret);
-
-        // 2.调用业务处理回调函数
-        if (_in_buffer.readableBytes() > 0)
+        _timerfd = createTimerFd();
+        _timer_channel = std::make_unique<Channel>(_timerfd, _looper);
+        // 为定时器设置到期任务回调函数
+        _timer_channel->setReadCallback(std::bind(&TimerWheel::onTime, this));
+        // 启动timerfd的读事件监控
+        _timer_channel->enableRead();
+    };
+    ~TimerWheel()
+    {
+        if (_timeout_req)
         {
-            _message_cb(shared_from_this(), _in_buffer);
+            _uring->releaseRequest(_timeout_req.release());
         }
     }
-    // 描述符可写事件发生
-    void handleWrite()
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // 当前时刻（毫秒，从时间轮创建开始计，任意线程可调用）
+    uint64_t now() const
     {
-        DF_DEBUG("连接%d可写事件发生", _socket.Fd());
-        // 1.把out_buffer中的数据写到socket中
-        ssize_t ret = _socket.NonBlockSend(_out_buffer.readPos(), _out_buffer.readableBytes());
-        if (ret < 0)
+        return monotonicMs() - _base_ms;
+    }
+
+    // delay毫秒后执行cb，interval>0时之后每隔interval毫秒重复执行（任意线程可调用）
+    TimerId addTimer(uint64_t delay, uint64_t interval, Task cb);
+    // 取消定时器（已结束的句柄无效果，任意线程可调用）
+    void cancelTimer(TimerId id);
+    // 从当前时刻重新开始计时（任意线程可调用）
+    void resetTimer(TimerId id);
+
+    // 嵌入式节点：添加（已在时间轮中则按新的超时时长重新计时），只能在EventLoop线程中调用
+    void addTimer(TimerNode *node, uint64_t timeout, uint64_t interval, Task cb)
+    {
+        cancelTimer(node);
+        node->_timeout = timeout;
+        node->_interval = interval;
+        node->_callback = std::move(cb);
+        schedule(node, now() + timeout);
+    }
+    // 嵌入式节点：从当前时刻重新开始计时，只能在EventLoop线程中调用
+    void resetTimer(TimerNode *node)
+    {
+        if (node->linked())
         {
-            // 写入失败，关闭连接
-            handleClose();
-            return;
+            unlink(node);
         }
-        // 2.数据写入成功，移动读指针
-        _out_buffer.moveReadIdx(ret);
-        // 3.数据写入成功，关闭写事件监控
-        if (_out_buffer.readableBytes() == 0)
+        else if (!node->_running)
         {
-            _channel.disableWrite();
-            // 如果当前连接是待关闭状态，则需要释放连接
-            if (_status == CLOSING)
-            {
-                release();
-            }
+            // 已经到期或被取消
+            return;
         }
+        schedule(node, now() + node->_timeout);
     }
-    // 描述符关闭事件发生
-    void handleClose()
+    // 嵌入式节点：取消，只能在EventLoop线程中调用
+    void cancelTimer(TimerNode *node)
     {
-        // 看看读缓冲区有没有需要处理的数据，然后再关闭
-        if (_in_buffer.readableBytes() > 0)
+        if (node->linked())
         {
-            if (_message_cb)
-            {
-                _message_cb(shared_from_this(), _in_buffer);
-            }
+            unlink(node);
+        }
+        if (node->_running)
+        {
+            // 回调执行期间被取消，回调结束后不再重复
+            node->_cancelled = true;
         }
-        release();
     }
-    // 描述符错误事件发生
-    void handleError()
+
+    // 时间轮中等待到期的定时器数量（只能在EventLoop线程中调用）
+    size_t size() const
     {
-        handleClose();
+        return _count;
     }
-    // 描述符任意事件发生
-    void handleAny()
+
+private:
+    // 由节点池提供的节点，在EventLoop线程中加入时间轮
+    void addTimerInLoop(uint32_t index, uint32_t gen, uint64_t delay)
     {
-        // 刷新连接活跃度
-        if (_enable_inactive_close == true)
+        TimerNode *node = lookup(TimerId(index, gen));
+        if (node == nullptr)
         {
-            _looper->resetTimer(_conn_id);
+            // 加入之前就被取消了
+            return;
         }
-
-        // 调用组件使用者的任意事件回调函数
-        if (_any_cb)
+        schedule(node, now() + delay);
+    }
+    void cancelTimerInLoop(TimerId id)
+    {
+        TimerNode *node = lookup(id);
+        if (node == nullptr)
+        {
+            return;
+        }
+        cancelTimer(node);
+        if (!node->_running)
+        {
+            freeNode(node);
+        }
+    }
+    void resetTimerInLoop(TimerId id)
+    {
+        TimerNode *node = lookup(id);
+        if (node != nullptr)
         {
-            _any_cb(shared_from_this());
+            resetTimer(node);
         }
     }
 
-    // 对于连接的所有操作，都应该在EventLoop所在的线程中进行
-    // 发送数据
-    void sendInLoop(const char *data, size_t len)
+    // 节点池：只有分配和查找需要加锁（其它线程调用addTimer时分配节点）
+    TimerNode *lookup(TimerId id)
     {
-        if (_status == CLOSED)
+        std::unique_lock<std::mutex> lock(_pool_mtx);
+        if (id._index >= _nodes.size() || _nodes[id._index]._gen != id._gen)
         {
-            return;
+            return nullptr;
         }
-        // 向缓冲区写入数据
-        _out_buffer.write(data, len);
-        // 开启写事件监听
-        if (_channel.isWriteAble() == false)
+        return &_nodes[id._index];
+    }
+    void freeNode(TimerNode *node)
+    {
+        // 回调中捕获的资源在锁外释放
+        node->_callback = nullptr;
+        std::unique_lock<std::mutex> lock(_pool_mtx);
+        node->_gen++;
+        _free_nodes.push_back(node->_index);
+    }
+
+    // 按到期时刻放入时间轮，必要时提前唤醒时刻
+    void schedule(TimerNode *node, uint64_t expire)
+    {
+        node->_expire = expire;
+        link(node);
+        uint64_t wakeup = std::max(expire, _current);
+        if (wakeup < _armed_at)
         {
-            _channel.enableWrite();
+            armWakeup(wakeup);
         }
     }
 
-    // 停止连接（要先检查缓冲区中是否还有数据待处理，再关闭连接）
-    void shutdownInLoop()
+    void link(TimerNode *node)
     {
-        _status = CLOSING;
-        // 1.检查读缓冲区中是否还有数据待处理，有的话先处理完
-        if (_in_buffer.readableBytes() > 0)
+        uint64_t expire = std::max(node->_expire, _current); // 已过期的放到下一个要处理的槽
+        uint64_t delta = expire - _current;
+        TimerListHead *slot = nullptr;
+        int level = 0;
+        if (delta < NEAR_SIZE)
         {
-            DF_DEBUG("连接%d还有数据待处理, 先处理完再关闭", _socket.Fd());
-            if (_message_cb)
+            slot = &_near[expire & NEAR_MASK];
+        }
+        else
+        {
+            if (delta >= (1ull << MAX_BITS))
+            {
+                // 超出时间轮范围，先放在最高层最远的槽，下移时再重新放置
+                expire = _current + (1ull << MAX_BITS) - 1;
+                delta = expire - _current;
+            }
+            level = 1;
+            while (level < LEVELS && delta >= (1ull << (NEAR_BITS + level * LEVEL_BITS)))
             {
-                _message_cb(shared_from_this(), _in_buffer);
+                level++;
             }
+            int shift = NEAR_BITS + (level - 1) * LEVEL_BITS;
+            slot = &_levels[level - 1][(expire >> shift) & LEVEL_MASK];
         }
-        // 2.检查写缓冲区中是否还有数据待发送
-        if (_out_buffer.readableBytes() > 0)
+        // 插入链表尾
+        node->prev = slot->prev;
+        node->next = slot;
+        slot->prev->next = node;
+        slot->prev = node;
+        node->_level = level;
+        _level_count[level]++;
+        _count++;
+    }
+
+    void unlink(TimerNode *node)
+    {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+        _level_count[node->_level]--;
+        _count--;
+    }
+
+    // 把一个槽的链表整体摘下，挂到list上
+    void takeList(TimerListHead *slot, TimerListHead *list)
+    {
+        if (slot->next == slot)
         {
-            DF_DEBUG("连接%d有数据待发送, 启动写事件监控", _socket.Fd());
-            // 有数据待发送，启动写事件监控，交给handleWrite发送完数据后再去关闭
-            _channel.enableWrite();
+            list->prev = list->next = list;
+            return;
         }
-        else
+        list->next = slot->next;
+        list->prev = slot->prev;
+        list->next->prev = list;
+        list->prev->next = list;
+        slot->prev = slot->next = slot;
+    }
+
+    // 第0层转完一圈，上层对应的槽下移（逐层，直到某一层没有回绕）
+    void cascade()
+    {
+        for (int level = 0; level < LEVELS; level++)
         {
-            DF_DEBUG("连接%d没有数据待发送, 直接关闭", _socket.Fd());
-            // 没有数据待发送，直接关闭
-            release();
+            int shift = NEAR_BITS + level * LEVEL_BITS;
+            size_t idx = (_current >> shift) & LEVEL_MASK;
+            TimerListHead list;
+            takeList(&_levels[level][idx], &list);
+            while (list.next != &list)
+            {
+                TimerNode *node = static_cast<TimerNode *>(list.next);
+                // 从临时链表中摘下，计数仍记在原来的层上
+                list.next = node->next;
+                node->next->prev = &list;
+                node->prev = node->next = nullptr;
+                _level_count[node->_level]--;
+                _count--;
+                link(node);
+            }
+            if (idx != 0)
+            {
+                break;
+            }
         }
     }
 
-    // 释放连接（关闭连接）
-    void releaseInLoop()
+    // 处理到now为止的所有刻度
+    void advance(uint64_t now)
     {
-        // 0.设置连接状态为已关闭
-        _status = CLOSED;
-        // 1.移除描述符事件监控
-        _looper->removeEvent(&_channel);
-        // 2.关闭连接
-        _socket.Close();
-        // 3.如果开启了非活跃连接关闭，则取消
-        if (_enable_inactive_close == true)
+        while (_current <= now)
         {
-            disableInactiveCloseInLoop();
+            if ((_current & NEAR_MASK) == 0)
+            {
+                cascade();
+            }
+            if (_level_count[0] == 0)
+            {
+                // 第0层没有定时器，直接跳到下一次下移的时刻
+                _current = std::min((_current | NEAR_MASK) + 1, now + 1);
+                continue;
+            }
+            TimerListHead expired;
+            takeList(&_near[_current & NEAR_MASK], &expired);
+            _current++;
+            // 逐个摘下执行（回调中可能取消同一批的其它定时器）
+            while (expired.next != &expired)
+            {
+                TimerNode *node = static_cast<TimerNode *>(expired.next);
+                unlink(node);
+                fire(node);
+            }
         }
-        // 4.调用连接关闭回调函数（用户设定）
-        if (_closed_cb)
+    }
+
+    void fire(TimerNode *node)
+    {
+        node->_running = true;
+        node->_cancelled = false;
+        // 回调移到局部变量中执行：回调中重新addTimer同一节点会替换node->_callback，不能销毁正在执行的闭包
+        Task cb = std::move(node->_callback);
+        node->_callback = nullptr;
+        cb();
+        node->_running = false;
+        if (!node->_callback)
         {
-            _closed_cb(shared_from_this());
+            // 回调中没有设置新的回调，重复执行或者重置后仍使用原来的
+            node->_callback = std::move(cb);
         }
-        // 5.调用连接关闭回调函数（组件内部）
-        if (_server_closed_cb)
+        if (node->linked())
+        {
+            // 回调中被重置
+            return;
+        }
+        if (node->_interval > 0 && !node->_cancelled)
+        {
+            // 按原定节奏重复，落后太多时从当前时刻算起
+            node->_expire = std::max(node->_expire + node->_interval, _current);
+            link(node);
+            return;
+        }
+        if (node->_index != UINT32_MAX)
         {
-            _server_closed_cb(shared_from_this());
+            freeNode(node);
         }
     }
-    // 连接获取后，描述符的设置，组件内的连接真正建立
-    void establishedInLoop()
+
+    // 下一个需要处理的刻度（没有定时器时返回NEVER）
+    uint64_t nextWakeup() const
     {
-        assert(_status == CONNECTING);
-        // 1.设置连接状态
-        _status = CONNECTED;
-        // 2.启动读事件监控
-        _channel.enableRead();
-        // 3.调用连接建立回调函数（用户设定）
-        if (_connected_cb)
+        if (_count == 0)
+        {
+            return NEVER;
+        }
+        if (_level_count[0] > 0)
+        {
+            // 本圈剩余的槽中找第一个非空的，找不到（都在下一圈）就在本圈结束时唤醒
+            for (uint64_t tick = _current; (tick & NEAR_MASK) != 0 || tick == _current; tick++)
+            {
+                const TimerListHead &slot = _near[tick & NEAR_MASK];
+                if (slot.next != &slot)
+                {
+                    return tick;
+                }
+            }
+            return (_current | NEAR_MASK) + 1;
+        }
+        for (int level = 0; level < LEVELS; level++)
         {
-            _connected_cb(shared_from_this());
+            if (_level_count[level + 1] == 0)
+            {
+                continue;
+            }
+            // 本层在本圈剩余的槽中找第一个非空的，下移发生在该槽开始的时刻
+            int shift = NEAR_BITS + level * LEVEL_BITS;
+            uint64_t base = _current >> shift;
+            for (uint64_t k = 1; ((base + k) & LEVEL_MASK) != 0; k++)
+            {
+                const TimerListHead &slot = _levels[level][(base + k) & LEVEL_MASK];
+                if (slot.next != &slot)
+                {
+                    return (base + k) << shift;
+                }
+            }
+            // 都在下一圈，本层回绕时唤醒
+            return ((_current >> (shift + LEVEL_BITS)) + 1) << (shift + LEVEL_BITS);
         }
+        return NEVER;
     }
-    // 开启非活跃连接关闭
-    void enableInactiveCloseInLoop(int sec)
+
+    // 设置在刻度tick时唤醒（绝对时间，一次性）：timerfd，或者io_uring的timeout请求（进行中的直接修改时刻）
+    void armWakeup(uint64_t tick)
     {
-        if (_enable_inactive_close == false)
+        uint64_t ms = _base_ms + tick;
+        _armed_at = tick;
+        if (_uring)
         {
-            _enable_inactive_close = true;
+            _timeout_ts.tv_sec = ms / 1000;
+            _timeout_ts.tv_nsec = (ms % 1000) * 1000000;
+            if (_timeout_req->inflight)
+            {
+                _uring->updateTimeout(_timeout_req.get(), &_timeout_ts);
+            }
+            else
+            {
+                _uring->submitTimeout(_timeout_req.get(), &_timeout_ts);
+            }
+            return;
         }
-        // 如果当前连接已经有定时器，则重置定时器
-        if (_looper->hasTimer(_conn_id))
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = ms / 1000;
+        its.it_value.tv_nsec = (ms % 1000) * 1000000;
+        if (timerfd_settime(_timerfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
         {
-            _looper->resetTimer(_conn_id);
+            DF_ERROR("Timerfd set time failed");
+            abort();
         }
-        // 如果定时器不存在，则添加释放连接的定时任务
-        else
+    }
+
+    static uint64_t monotonicMs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    static void initList(TimerListHead *heads, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
         {
-            _looper->addTimer(_conn_id, sec, std::bind(&Connection::release, this));
+            heads[i].prev = heads[i].next = &heads[i];
         }
     }
-    // 取消非活跃连接关闭
-    void disableInactiveCloseInLoop()
+
+    // 创建一个timerfd（按需设置，初始不触发）
+    static int createTimerFd()
     {
-        _enable_inactive_close = false;
-        _looper->cancelTimer(_conn_id);
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd == -1)
+        {
+            DF_ERROR("Timerfd create failed");
+            abort();
+        }
+        return tfd;
     }
-    // 切换协议上下文
-    void upgradeContextInLoop(const Any &context,
-                              const ConnectionCallback &closed_cb,
-                              const ConnectionCallback &connected_cb,
-                              const ConnectionCallback &any_cb,
-                              const MessageCallback &message_cb)
+
+    // 读取清空timerfd的数据
+    void readTimerFd()
     {
-        _context = context;
-        _closed_cb = closed_cb;
-        _connected_cb = connected_cb;
-        _any_cb = any_cb;
-        _message_cb = message_cb;
+        uint64_t times;
+        ssize_t ret = read(_timerfd, &times, sizeof(uint64_t));
+        if (ret < 0 && errno != EINTR && errno != EAGAIN)
+        {
+            DF_ERROR("Timerfd read failed");
+        }
     }
 
-public:
-    Connection(EventLoop *looper, int sockfd, uint64_t conn_id)
-        : _conn_id(conn_id), _socket(sockfd), _status(CONNECTING), _looper(looper), _channel(sockfd, looper), _enable_inactive_close(false)
+    // 定时器超时处理的回调函数
+    void onTime()
     {
-        // 设置channel的回调函数
-        _channel.setReadCallback(std::bind(&Connection::handleRead, this));
-        _channel.setWriteCallback(std::bind(&Connection::handleWrite, this));
-        _channel.setErrorCallback(std::bind(&Connection::handleError, this));
-        _channel.setCloseCallback(std::bind(&Connection::handleClose, this));
-        _channel.setAnyCallback(std::bind(&Connection::handleAny, this));
+        // 处理timerfd的读事件，把数据读掉，以防一次超时多次处理
+        readTimerFd();
+        expire();
     }
-    ~Connection()
+    // io_uring的timeout请求完成（到期为-ETIME，被撤销为-ECANCELED）
+    void onTimeout(int res, const char *, size_t, bool)
     {
-        DF_DEBUG("Connection destructed, id: %d", _conn_id);
+        if (res != -ECANCELED)
+        {
+            expire();
+        }
     }
-    int Fd() const // 获取连接的描述符
+    void expire()
     {
-        return _socket.Fd();
+        _armed_at = NEVER;
+        // 处理到当前时刻为止的所有刻度，再按下一个需要处理的刻度设置唤醒时刻
+        advance(now());
+        uint64_t wakeup = nextWakeup();
+        if (wakeup != NEVER && wakeup < _armed_at)
+        {
+            armWakeup(wakeup);
+        }
     }
-    int Id() const // 获取连接的ID#
+
+private:
+    EventLoop *_looper;  // 绑定的event loop
+    uint64_t _base_ms;   // 时间轮创建时的单调时钟（毫秒）
+    uint64_t _current;   // 下一个要处理的刻度
+    uint64_t _armed_at;  // timerfd设置的触发刻度
+    size_t _count;       // 时间轮中的定时器数量
+
+    TimerListHead _near[NEAR_SIZE];           // 第0层
+    TimerListHead _levels[LEVELS][LEVEL_SIZE]; // 上层
+    size_t _level_count[LEVELS + 1] = {};     // 每层的定时器数量（0为第0层）
+
+    std::deque<TimerNode> _nodes;     // 节点池（deque扩容时已有节点地址不变）
+    std::vector<uint32_t> _free_nodes; // 空闲节点下标
+    std::mutex _pool_mtx;             // 保护节点池的分配与查找
+
+    int _timerfd;                            // 用于超时事件监控（io_uring完成驱动模式下为-1）
+    std::unique_ptr<Channel> _timer_channel; // timerfd的channel
+
+    UringPoller *_uring;                        // io_uring完成驱动模式下的事件监控器
+    std::unique_ptr<UringRequest> _timeout_req; // io_uring的timeout请求
+    struct __kernel_timespec _timeout_ts;       // timeout请求的到期时刻（单调时钟）
+};
+
+/*
+
+    ConnectionSlots：事件循环所拥有的连接表
+
+*/
+class Connection;
+using PtrConnection = std::shared_ptr<Connection>;
+
+// 以槽位为单位的连接表，每个EventLoop一份，插入和删除只在EventLoop线程中进行，不加锁
+// 连接ID为64位：高12位是EventLoop编号，中间28位是槽位的代数（槽位每复用一次加1），低24位是槽位下标
+// 连接关闭后槽位代数改变，旧ID不会查到新连接
+// find可以在任意线程调用（无锁），用于少量跨线程“按ID查找连接”的场景
+class ConnectionSlots
+{
+    static const int SLOT_BITS = 24;
+    static const int GEN_BITS = 28;
+    static const int LOOP_BITS = 12;
+    static const uint32_t SLOT_MASK = (1u << SLOT_BITS) - 1;
+    static const uint32_t GEN_MASK = (1u << GEN_BITS) - 1;
+
+    static const size_t CHUNK_SIZE = 4096;                        // 每块的槽位数
+    static const size_t MAX_CHUNKS = (1u << SLOT_BITS) / CHUNK_SIZE; // 块数上限（每个EventLoop最多1600多万个连接）
+
+    struct Slot
     {
-        return _conn_id;
+        std::atomic<uint64_t> id{0}; // 占用时为连接ID，空闲时为0
+        std::atomic<Connection *> raw{nullptr};
+        PtrConnection conn; // 持有连接（只在EventLoop线程中访问）
+        uint32_t gen = 0;   // 槽位代数
+    };
+
+public:
+    static const uint32_t MAX_LOOPS = 1u << LOOP_BITS;
+
+    ConnectionSlots()
+    {
+        for (auto &chunk : _chunks)
+        {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
     }
-    void setContext(const Any &context)
+    ~ConnectionSlots()
     {
-        _context = context;
+        for (auto &chunk : _chunks)
+        {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
     }
-    Any *getContext()
+    ConnectionSlots(const ConnectionSlots &) = delete;
+    ConnectionSlots &operator=(const ConnectionSlots &) = delete;
+
+    // 设置所属EventLoop的编号（EventLoop创建后、分配连接之前设置）
+    void setLoopIndex(uint32_t index)
     {
-        return &_context;
+        assert(index < MAX_LOOPS);
+        _loop_index = index;
     }
-    void send(const char *data, size_t len) // 发送数据
+    uint32_t loopIndex() const
     {
-        _looper->runInLoop(std::bind(&Connection::sendInLoop, this, data, len));
+        return _loop_index;
     }
-    void shutdown() // 关闭连接（并不实际关闭连接，需先判断缓冲区中是否还有数据）
+    // 从连接ID中取出EventLoop编号
+    static uint32_t loopIndexOf(uint64_t id)
     {
-        _looper->runInLoop(std::bind(&Connection::shutdownInLoop, this));
+        return (uint32_t)(id >> (SLOT_BITS + GEN_BITS));
     }
-    void enableInactiveClose(int sec) // 启用连接空闲超时关闭
+
+    // 登记一个已经分配给本EventLoop、尚未创建的连接（任意线程，用于负载统计）
+    void expect()
     {
-        _looper->runInLoop(std::bind(&Connection::enableInactiveCloseInLoop, this, sec));
+        _pending.fetch_add(1, std::memory_order_relaxed);
     }
-    void disableInactiveClose() // 禁用连接空闲超时关闭
+    // 分配一个槽位，返回新连接的ID（EventLoop线程中调用，随后用attach放入连接）
+    uint64_t allocate()
     {
-        _looper->runInLoop(std::bind(&Connection::disableInactiveCloseInLoop, this));
+        reclaim();
+        size_t pending = _pending.load(std::memory_order_relaxed);
+        while (pending > 0 && !_pending.compare_exchange_weak(pending, pending - 1, std::memory_order_relaxed))
+        {
+        }
+        uint32_t index;
+        if (!_free_slots.empty())
+        {
+            index = _free_slots.back();
+            _free_slots.pop_back();
+        }
+        else
+        {
+            index = _next_slot++;
+            if (index >= MAX_CHUNKS * CHUNK_SIZE)
+            {
+                DF_FATAL("connection slots exhausted");
+                abort();
+            }
+            if (index % CHUNK_SIZE == 0)
+            {
+                _chunks[index / CHUNK_SIZE].store(new Slot[CHUNK_SIZE], std::memory_order_release);
+            }
+        }
+        Slot &slot = slotAt(index);
+        // 代数为0的ID保留为无效ID
+        slot.gen = (slot.gen + 1) & GEN_MASK;
+        if (slot.gen == 0)
+        {
+            slot.gen = 1;
+        }
+        return ((uint64_t)_loop_index << (SLOT_BITS + GEN_BITS)) | ((uint64_t)slot.gen << SLOT_BITS) | index;
     }
-
-    // 切换协议上下文，需要更改回调函数
-    // 必须在EventLoop线程立即执行，防止放入任务队列后，新事件触发并先于upgradeContext处理，此时用的是旧的协议，不符合预期
-    void upgradeContext(const Any &context,
-                        const ConnectionCallback &closed_cb,
-                        const ConnectionCallback &connected_cb,
-                        const ConnectionCallback &any_cb,
-                        const MessageCallback &message_cb)
+    // 把连接放入allocate分配的槽位
+    void attach(uint64_t id, const PtrConnection &conn)
     {
-        _looper->assertInLoop();
-        _looper->runInLoop(std::bind(&Connection::upgradeContextInLoop, this,
-                                     context, closed_cb, connected_cb, any_cb, message_cb));
+        Slot &slot = slotAt(id & SLOT_MASK);
+        slot.conn = conn;
+        slot.raw.store(conn.get());
+        slot.id.store(id);
+        _size.fetch_add(1, std::memory_order_relaxed);
     }
-
-    // 释放连接（任务队列中执行，防止释放前进行业务处理）
-    void release()
+    // 移除连接并回收槽位（EventLoop线程中调用）
+    bool erase(uint64_t id)
     {
-        _looper->cacheTask(std::bind(&Connection::releaseInLoop, this));
+        uint32_t index = id & SLOT_MASK;
+        if (index >= _next_slot || slotAt(index).id.load(std::memory_order_relaxed) != id)
+        {
+            return false;
+        }
+        Slot &slot = slotAt(index);
+        slot.id.store(0);
+        slot.raw.store(nullptr);
+        _free_slots.push_back(index);
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        // 有其它线程正在查找时，它可能已经拿到了连接的裸指针，连接暂不释放，等没有查找者时再释放
+        if (_readers.load() == 0)
+        {
+            slot.conn.reset();
+        }
+        else
+        {
+            _retired.push_back(std::move(slot.conn));
+        }
+        reclaim();
+        return true;
     }
-    // 连接建立就绪后，对Channel进行设置，启动读事件监控，调用连接建立回调函数connected_cb
-    void established()
+    // 按ID查找连接（任意线程，无锁），连接已关闭或ID无效时返回空
+    PtrConnection find(uint64_t id) const
     {
-        _looper->runInLoop(std::bind(&Connection::establishedInLoop, this));
+        uint32_t index = id & SLOT_MASK;
+        if (id == 0 || index / CHUNK_SIZE >= MAX_CHUNKS)
+        {
+            return PtrConnection();
+        }
+        Slot *chunk = _chunks[index / CHUNK_SIZE].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+        {
+            return PtrConnection();
+        }
+        Slot &slot = chunk[index % CHUNK_SIZE];
+        PtrConnection conn;
+        _readers.fetch_add(1);
+        if (slot.id.load() == id)
+        {
+            Connection *raw = slot.raw.load();
+            // 读者计数不为0期间，EventLoop线程不会释放被移除的连接，裸指针一定有效
+            if (raw != nullptr && slot.id.load() == id)
+            {
+                conn = sharedFrom(raw);
+            }
+        }
+        _readers.fetch_sub(1);
+        return conn;
     }
-
-    void setClosedCallback(const ConnectionCallback &cb) // 设置连接关闭回调函数
+    // 当前连接数（任意线程可读）
+    size_t size() const
     {
-        _closed_cb = cb;
+        return _size.load(std::memory_order_relaxed);
     }
-    void setConnectedCallback(const ConnectionCallback &cb) // 设置连接建立回调函数
+    // 已登记、尚未创建的连接数（任意线程可读）
+    size_t pending() const
     {
-        _connected_cb = cb;
+        return _pending.load(std::memory_order_relaxed);
     }
-    void setAnyCallback(const ConnectionCallback &cb) // 设置任意事件回调函数
+    // 遍历所有连接（EventLoop线程中调用）
+    template <class Fn>
+    void forEach(Fn fn)
     {
-        _any_cb = cb;
+        for (uint32_t i = 0; i < _next_slot; i++)
+        {
+            Slot &slot = slotAt(i);
+            if (slot.conn && slot.id.load(std::memory_order_relaxed) != 0)
+            {
+                fn(slot.conn);
+            }
+        }
     }
-    void setMessageCallback(const MessageCallback &cb) // 设置业务处理回调函数
+
+private:
+    Slot &slotAt(uint32_t index) const
     {
-        _message_cb = cb;
+        return _chunks[index / CHUNK_SIZE].load(std::memory_order_relaxed)[index % CHUNK_SIZE];
     }
-    void setServerClosedCallback(const ConnectionCallback &cb) // 设置组件内部使用的连接关闭回调函数
+    // 释放移除时有查找者、暂缓释放的连接
+    void reclaim()
     {
-        _server_closed_cb = cb;
+        if (!_retired.empty() && _readers.load() == 0)
+        {
+            _retired.clear();
+        }
     }
+    // Connection此时还是不完整类型，定义在Connection之后
+    static PtrConnection sharedFrom(Connection *raw);
+
+private:
+    uint32_t _loop_index = 0;
+    std::atomic<Slot *> _chunks[MAX_CHUNKS]; // 分块存放槽位，块一旦分配不再移动，其它线程可以无锁读取
+    uint32_t _next_slot = 0;                 // 尚未使用过的第一个槽位
+    std::vector<uint32_t> _free_slots;       // 空闲槽位
+    std::vector<PtrConnection> _retired;     // 移除时有查找者、暂缓释放的连接
+    std::atomic<size_t> _size{0};            // 当前连接数
+    std::atomic<size_t> _pending{0};         // 已登记、尚未创建的连接数
+    mutable std::atomic<int> _readers{0};    // 正在查找的线程数
 };
 
 /*
 
-    Acceptor: 监听连接管理
+    EventLoop：事件循环
 
 */
+// 事件循环的实时负载（任意线程可读，用于给新连接选择EventLoop）
+struct LoopLoad
+{
+    size_t connections = 0;     // 连接数（包括已分配、尚未创建的连接）
+    uint64_t queued_bytes = 0;  // 所有连接待发送的字节数
+    uint32_t busy_permille = 0; // 最近一个统计周期内处理事件和任务的时间占比（千分比）
+
+    // 综合负载：1个连接、64KB待发送数据、0.1%的忙碌时间各算1分
+    uint64_t score() const
+    {
+        return connections + queued_bytes / 65536 + busy_permille;
+    }
+};
+
+// 忙轮询的统计（任意线程可读）
+struct BusyPollStats
+{
+    uint64_t spin_hits = 0;     // 空转期间等到了事件的次数
+    uint64_t spin_misses = 0;   // 空转预算用完仍没有事件、转入阻塞等待的次数
+    uint64_t mode_switches = 0; // 按观察到的负载开启/关闭空转的次数
+    bool spinning = false;      // 当前是否处于空转模式
+};
+
+class EventLoop
+{
+    using Task = InplaceFunction<void()>;
+    static const uint64_t BUSY_WINDOW_NS = 100 * 1000 * 1000; // 忙碌时间的统计周期（100ms）
+    static const uint32_t SPIN_SAMPLES = 64;                  // 每观察多少轮事件监听决定一次是否空转
+    static const uint32_t SPIN_HIT_PERCENT = 50;              // 预算内等到事件的比例不低于此值时空转
+    static const uint32_t MAX_SPIN_BACKOFF = 64;              // 空转关闭后最多等待多少次决策再重新考虑
+
+public:
+    using TimerCallback = TimerNode::Task;
+
+    EventLoop(PollerBackend backend = EPOLL_BACKEND)
+        : _thread_id(std::this_thread::get_id()), _poller(Poller::Create(backend)), _eventfd(createEventFd()), _event_channel(std::make_unique<Channel>(_eventfd, this)), _timer_wheel(this, _poller->uring())
+    {
+        // 给eventfd添加读事件的回调函数
+        _event_channel->setReadCallback(std::bind(&EventLoop::readEventFd, this));
+        // 开启eventfd读事件监听
+        _event_channel->enableRead();
+        // 缓冲区内存池每秒做一次空闲收缩
+        runEvery(1000, std::bind(&BufferPool::shrinkIdle, &_buffer_pool));
+    }
+    ~EventLoop()
+    {
+        // 释放没有来得及执行的任务
+        TaskNode *node = _task_head.exchange(nullptr);
+        while (node)
+        {
+            TaskNode *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    // 运行事件循环，直到quit
+    void start()
+    {
+        _window_start = monotonicNs();
+        while (!_quit.load(std::memory_order_acquire))
+        {
+            // 1.IO事件监听（活跃数组每轮复用，不再重新分配）
+            pollEvents();
+            uint64_t begin = monotonicNs();
+
+            // 2.事件处理
+            for (auto &active_channel : _actives)
+            {
+                active_channel->handleEvent();
+            }
+
+            // 3.任务执行（其它线程的、延后处理的）
+            runAllTasks();
+
+            // 统计忙碌时间（不包括阻塞在事件监听上的时间）
+            accountBusy(begin, monotonicNs());
+        }
+        // 退出前执行完已投递的任务（如连接的释放）
+        runAllTasks();
+    }
+    // 退出事件循环（任意线程可调用），start处理完当前这一轮后返回
+    void quit()
+    {
+        _quit.store(true, std::memory_order_release);
+        if (!isInLoop())
+        {
+            weakupEventFd();
+        }
+    }
+
+    // 当前负载（任意线程可调用）
+    LoopLoad load()
+    {
+        LoopLoad load;
+        load.connections = _connections.size() + _connections.pending();
+        load.queued_bytes = _queued_bytes.load(std::memory_order_relaxed);
+        load.busy_permille = _busy_permille.load(std::memory_order_relaxed);
+        return load;
+    }
+    // 开启忙轮询（任意线程可调用，spin_us为0时关闭）
+    // 每轮处理完事件后先不阻塞，在spin_us微秒内反复检查就绪事件，预算用完仍没有事件再阻塞等待
+    // 省去了唤醒和上下文切换的延迟，代价是空转占用CPU；每个EventLoop按预算内等到事件的比例自动开关空转
+    void setBusyPoll(uint32_t spin_us)
+    {
+        runInLoop([this, spin_us]() {
+            _spin_ns = (uint64_t)spin_us * 1000;
+            _spin_samples = 0;
+            _spin_window_hits = 0;
+            _spin_backoff = 1;
+            _spin_holdoff = 0;
+            _spinning.store(spin_us > 0, std::memory_order_relaxed);
+        });
+    }
+    BusyPollStats busyPollStats()
+    {
+        BusyPollStats stats;
+        stats.spin_hits = _spin_hits.load(std::memory_order_relaxed);
+        stats.spin_misses = _spin_misses.load(std::memory_order_relaxed);
+        stats.mode_switches = _spin_switches.load(std::memory_order_relaxed);
+        stats.spinning = _spinning.load(std::memory_order_relaxed);
+        return stats;
+    }
+    // 本线程所有连接待发送字节数的计数器（连接的输出队列同步累加）
+    std::atomic<uint64_t> *queuedBytesCounter()
+    {
+        return &_queued_bytes;
+    }
+
+    // 本线程连接的缓冲区内存池（只能在EventLoop线程中申请和归还，统计信息任意线程可读）
+    BufferPool *bufferPool()
+    {
+        return &_buffer_pool;
+    }
+    // 本线程拥有的连接（只能在EventLoop线程中增删，查找和连接数任意线程可用）
+    ConnectionSlots *connections()
+    {
+        return &_connections;
+    }
+    // io_uring完成驱动模式下的事件监控器（其它情况返回nullptr，连接和监听套接字按就绪事件处理）
+    UringPoller *uring()
+    {
+        return _poller->uring();
+    }
+
+    // 判断当前线程是否是EventLoop所绑定的线程
+    bool isInLoop()
+    {
+        return std::this_thread::get_id() == _thread_id;
+    }
+
+    void assertInLoop()
+    {
+        assert(isInLoop() == true);
+    }
+
+    // 在这个EventLoop中执行任务 （其它线程可调用）
+    // EventLoop本线程任务：直接执行
+    // 其它线程任务：压入任务队列
+    void runInLoop(Task cb)
+    {
+        if (isInLoop())
+        {
+            cb();
+        }
+        else
+        {
+            // DF_DEBUG("有一个其它线程的任务到来，压入任务队列");
+            cacheTask(std::move(cb));
+        }
+    }
+
+    // 将任务暂时缓存到任务队列
+    void cacheTask(Task cb)
+    {
+        TaskNode *node = new TaskNode(std::move(cb));
+        pushTasks(node, node);
+    }
+
+    // 一次投递多个任务（按顺序执行），其它线程投递时最多只唤醒一次
+    void runInLoopBatch(std::vector<Task> tasks)
+    {
+        if (tasks.empty())
+        {
+            return;
+        }
+        if (isInLoop())
+        {
+            for (auto &t : tasks)
+            {
+                t();
+            }
+            return;
+        }
+        // 任务队列是后进先出的链表（取出时再反转），先投递的任务要放在链的末尾
+        TaskNode *last = new TaskNode(std::move(tasks[0]));
+        TaskNode *first = last;
+        for (size_t i = 1; i < tasks.size(); i++)
+        {
+            TaskNode *node = new TaskNode(std::move(tasks[i]));
+            node->next = first;
+            first = node;
+        }
+        pushTasks(first, last);
+    }
+
+    // 新增/修改监控事件
+    bool updateEvent(Channel *channel)
+    {
+        return _poller->updateEvent(channel);
+    }
+
+    // 移除监控事件
+    bool removeEvent(Channel *channel)
+    {
+        return _poller->removeEvent(channel);
+    }
+
+    // 当前时刻（毫秒，单调时钟，从事件循环创建开始计，runAt使用这个时间）
+    uint64_t now() const
+    {
+        return _timer_wheel.now();
+    }
+    // delay毫秒后执行一次（任意线程可调用，回调在EventLoop线程中执行）
+    TimerId runAfter(uint64_t delay, TimerCallback cb)
+    {
+        return _timer_wheel.addTimer(delay, 0, std::move(cb));
+    }
+    // 每隔interval毫秒执行一次（任意线程可调用）
+    TimerId runEvery(uint64_t interval, TimerCallback cb)
+    {
+        assert(interval > 0);
+        return _timer_wheel.addTimer(interval, interval, std::move(cb));
+    }
+    // 在when时刻（now()的时间）执行一次（任意线程可调用）
+    TimerId runAt(uint64_t when, TimerCallback cb)
+    {
+        uint64_t current = now();
+        return _timer_wheel.addTimer(when > current ? when - current : 0, 0, std::move(cb));
+    }
+    // 取消定时任务（定时任务已结束时无效果，任意线程可调用）
+    void cancelTimer(TimerId id)
+    {
+        _timer_wheel.cancelTimer(id);
+    }
+    // 重置定时任务，从当前时刻重新计时（任意线程可调用）
+    void resetTimer(TimerId id)
+    {
+        _timer_wheel.resetTimer(id);
+    }
+
+    // 嵌入在对象中的定时器节点（不需要分配内存），只能在EventLoop线程中调用
+    // 添加定时任务，节点已在时间轮中时按新的超时时长重新计时
+    void addTimer(TimerNode *node, uint64_t timeout, TimerCallback cb)
+    {
+        assertInLoop();
+        _timer_wheel.addTimer(node, timeout, 0, std::move(cb));
+    }
+    // 重置定时任务
+    void resetTimer(TimerNode *node)
+    {
+        assertInLoop();
+        _timer_wheel.resetTimer(node);
+    }
+    // 取消定时任务
+    void cancelTimer(TimerNode *node)
+    {
+        assertInLoop();
+        _timer_wheel.cancelTimer(node);
+    }
+
+private:
+    // 任务队列的侵入式链表节点
+    struct TaskNode
+    {
+        explicit TaskNode(Task &&t) : task(std::move(t)) {}
+        TaskNode *next = nullptr;
+        Task task;
+    };
+
+    static uint64_t monotonicNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+    // 事件监听：未开启忙轮询时直接阻塞等待
+    void pollEvents()
+    {
+        if (_spin_ns == 0)
+        {
+            _poller->poll(_actives);
+            return;
+        }
+        // 先不阻塞地检查一次，已有就绪事件时（如刚开启的写事件）空转与否没有区别，不计入统计
+        _poller->poll(_actives, 0);
+        if (!_actives.empty())
+        {
+            return;
+        }
+        uint64_t start = monotonicNs();
+        if (_spinning.load(std::memory_order_relaxed))
+        {
+            // 空转：不阻塞地反复检查，预算内等到事件算命中
+            uint64_t deadline = start + _spin_ns;
+            while (monotonicNs() < deadline)
+            {
+                _poller->poll(_actives, 0);
+                if (!_actives.empty())
+                {
+                    _spin_hits.fetch_add(1, std::memory_order_relaxed);
+                    recordSpinSample(true);
+                    return;
+                }
+            }
+            _spin_misses.fetch_add(1, std::memory_order_relaxed);
+            recordSpinSample(false);
+            _poller->poll(_actives);
+            return;
+        }
+        // 阻塞等待：等待时长不超过预算，说明空转的话能够命中
+        _poller->poll(_actives);
+        recordSpinSample(monotonicNs() - start <= _spin_ns);
+    }
+    // 记录一轮事件监听是否在预算内等到了事件，每SPIN_SAMPLES轮按命中比例决定之后是否空转
+    // 阻塞时的等待时长只是估计（比如CPU不够时，对端要等本线程让出CPU才能发数据，空转反而等不到），
+    // 空转实际命中率不够而关闭后，按指数退避多观察几轮再重新开启，避免反复切换
+    void recordSpinSample(bool hit)
+    {
+        _spin_samples++;
+        _spin_window_hits += hit ? 1 : 0;
+        if (_spin_samples < SPIN_SAMPLES)
+        {
+            return;
+        }
+        bool worth = _spin_window_hits * 100 >= _spin_samples * SPIN_HIT_PERCENT;
+        _spin_samples = 0;
+        _spin_window_hits = 0;
+        if (_spinning.load(std::memory_order_relaxed))
+        {
+            if (worth)
+            {
+                _spin_backoff = 1;
+                return;
+            }
+            setSpinning(false);
+            _spin_backoff = std::min(_spin_backoff * 2, (uint32_t)MAX_SPIN_BACKOFF);
+            _spin_holdoff = _spin_backoff;
+            return;
+        }
+        if (_spin_holdoff > 0)
+        {
+            _spin_holdoff--;
+            return;
+        }
+        if (worth)
+        {
+            setSpinning(true);
+        }
+    }
+    void setSpinning(bool spinning)
+    {
+        if (_spinning.load(std::memory_order_relaxed) != spinning)
+        {
+            _spinning.store(spinning, std::memory_order_relaxed);
+            _spin_switches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // 累加一轮事件处理的忙碌时间，每个统计周期结束时更新忙碌占比
+    void accountBusy(uint64_t begin, uint64_t end)
+    {
+        _window_busy += end - begin;
+        uint64_t elapsed = end - _window_start;
+        if (elapsed >= BUSY_WINDOW_NS)
+        {
+            _busy_permille.store((uint32_t)std::min<uint64_t>(1000, _window_busy * 1000 / elapsed), std::memory_order_relaxed);
+            _window_start = end;
+            _window_busy = 0;
+        }
+    }
+
+    // 把first->...->last这条链压入任务队列（无锁，多个线程可同时压入）
+    void pushTasks(TaskNode *first, TaskNode *last)
+    {
+        TaskNode *head = _task_head.load(std::memory_order_relaxed);
+        do
+        {
+            last->next = head;
+        } while (!_task_head.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+        // 只有任务队列由空变为非空时才需要唤醒（非空说明前面的投递者已经唤醒过，事件循环还没取走任务）
+        // 本线程在事件处理阶段投递的任务，本轮的任务执行阶段就会取走，也不需要唤醒
+        if (head == nullptr && (!isInLoop() || _running_tasks))
+        {
+            weakupEventFd();
+        }
+    }
+
+    void runAllTasks()
+    {
+        // 一次取出任务队列中的所有任务（执行期间新投递的任务留到下一轮），反转成先进先出
+        TaskNode *node = _task_head.exchange(nullptr, std::memory_order_acquire);
+        if (node == nullptr)
+        {
+            return;
+        }
+        TaskNode *list = nullptr;
+        while (node)
+        {
+            TaskNode *next = node->next;
+            node->next = list;
+            list = node;
+            node = next;
+        }
+        _running_tasks = true;
+        while (list)
+        {
+            TaskNode *cur = list;
+            list = list->next;
+            cur->task();
+            delete cur;
+        }
+        _running_tasks = false;
+    }
+
+    static int createEventFd()
+    {
+        int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (efd < 0)
+        {
+            DF_ERROR("Eventfd create failed");
+            abort();
+        }
+        return efd;
+    }
+
+    void readEventFd()
+    {
+        uint64_t signal = 0;
+        int ret = read(_eventfd, &signal, sizeof(uint64_t));
+        if (ret < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                return;
+            }
+            DF_ERROR("Eventfd read failed");
+            return;
+        }
+    }
+
+    void weakupEventFd()
+    {
+        uint64_t signal = 1;
+        int ret = write(_eventfd, &signal, sizeof(uint64_t));
+        if (ret < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                return;
+            }
+            DF_ERROR("Eventfd write failed");
+            return;
+        }
+    }
+
+private:
+    std::thread::id _thread_id;              // 事件循环所在线程id
+    std::unique_ptr<Poller> _poller;         // 事件监听器（epoll或io_uring）
+    std::vector<Channel *> _actives;         // 每轮监听到的活跃Channel
+    BufferPool _buffer_pool;                 // 本线程连接的缓冲区内存池（须比定时器后析构）
+    
+    int _eventfd;                            // 用于唤醒IO事件监听阻塞（向eventfd计数器写入，就有了一个读事件，就可以唤醒）
+    std::unique_ptr<Channel> _event_channel; // eventfd对应的channel
+
+    std::atomic<TaskNode *> _task_head{nullptr}; // 任务队列（无锁链表，后进先出，取出时反转）
+    bool _running_tasks = false;                 // 是否正在执行任务队列中的任务（只在本线程读写）
+    std::atomic<bool> _quit{false};              // 是否退出事件循环
+
+    TimerWheel _timer_wheel;                 // 定时器
+    ConnectionSlots _connections;            // 本线程拥有的连接（连接引用了内存池和定时器，须最先析构）
+
+    std::atomic<uint64_t> _queued_bytes{0};  // 本线程所有连接待发送的字节数
+    std::atomic<uint32_t> _busy_permille{0}; // 上一个统计周期的忙碌时间占比
+    uint64_t _window_start = 0;              // 当前统计周期的开始时刻（纳秒）
+    uint64_t _window_busy = 0;               // 当前统计周期内的忙碌时间（纳秒）
+
+    uint64_t _spin_ns = 0;                   // 忙轮询的空转预算（纳秒，0表示不开启）
+    uint32_t _spin_samples = 0;              // 本次决策已观察的事件监听轮数
+    uint32_t _spin_window_hits = 0;          // 其中在预算内等到事件的轮数
+    uint32_t _spin_backoff = 1;              // 空转关闭后的退避决策次数（每次空转失败翻倍）
+    uint32_t _spin_holdoff = 0;              // 剩余不重新开启空转的决策次数
+    std::atomic<bool> _spinning{false};      // 当前是否空转
+    std::atomic<uint64_t> _spin_hits{0};     // 空转命中次数
+    std::atomic<uint64_t> _spin_misses{0};   // 空转未命中次数
+    std::atomic<uint64_t> _spin_switches{0}; // 空转模式切换次数
+};
+
+/*
+
+    Connection: 通信连接管理
+
+*/
+typedef enum
+{
+    CLOSED,     // 已关闭
+    CONNECTED,  // 已连接：已完成各种设置，可进行通信
+    CLOSING,    // 关闭中：待关闭状态，缓冲区可能还有数据未处理
+    CONNECTING, // 连接中：待处理
+} ConnStat;
+
+// 连接的回调函数表：由服务器创建，所有连接共享同一份，创建后只读，由引用计数管理生命周期
+// 新连接只拷贝一个智能指针，不拷贝任何std::function；切换协议时整体替换表指针
+struct ConnectionHandlers
+{
+    using ConnectionCallback = std::function<void(const PtrConnection &)>;
+    using MessageCallback = std::function<void(const PtrConnection &, Buffer &)>;
+    using HighWaterMarkCallback = std::function<void(const PtrConnection &, size_t)>;
+
+    ConnectionCallback closed;             // 连接关闭回调函数
+    ConnectionCallback connected;          // 连接建立回调函数
+    ConnectionCallback any;                // 任意事件回调函数
+    MessageCallback message;               // 业务处理回调函数
+    ConnectionCallback write_complete;     // 输出队列发送完毕回调函数
+    HighWaterMarkCallback high_water_mark; // 输出队列超过高水位回调函数（参数是待发送的内存字节数）
+    ConnectionCallback low_water_mark;     // 输出队列从高水位之上降到低水位回调函数（此时已恢复读）
+};
+using PtrHandlers = std::shared_ptr<const ConnectionHandlers>;
+
+class Connection : public std::enable_shared_from_this<Connection>
+{
+    static const size_t MAX_SENDFILE_LEN = 1 << 30; // 单次sendfile的最大长度
+
+public:
+    static const size_t DEFAULT_EVENT_BUDGET = 256 * 1024; // 单次读写事件默认最多处理的字节数
+
+private:
+    uint64_t _conn_id;           // 连接的唯一标识ID
+    Socket _socket;              // 连接的套接字
+    ConnStat _status;            // 连接状态
+    Channel _channel;            // 连接事件管理
+    Buffer _in_buffer;           // 读缓冲区
+    OutputQueue _out_queue;      // 写缓冲区（分段输出队列）
+    Any _context;                // 协议上下文
+    EventLoop *_looper;          // 连接所绑定的事件循环
+    bool _enable_inactive_close; // 是否启用连接空闲超时关闭
+    TimerNode _idle_timer;       // 空闲超时定时器（嵌入连接对象，不需要分配内存）
+
+    bool _edge_triggered = false;                // 是否使用边缘触发
+    size_t _event_budget = DEFAULT_EVENT_BUDGET; // 单次读写事件最多处理的字节数
+    bool _quick_ack = false;                     // 是否每次读到数据后重新设置TCP_QUICKACK
+
+    size_t _high_water_mark = 0;    // 输出队列高水位（内存字节数，0表示不启用）
+    size_t _low_water_mark = 0;     // 输出队列低水位（降到此值以下恢复读）
+    uint32_t _slow_evict_ms = 0;    // 持续高于高水位多久后关闭连接（毫秒，0表示不关闭）
+    bool _above_high_water = false; // 是否处于高水位之上（此时读事件暂停）
+    TimerNode _evict_timer;         // 慢消费者驱逐定时器
+
+    uint64_t _direct_read_bytes = 0; // 直接读进in_buffer的字节数
+    uint64_t _spill_read_bytes = 0;  // 先读进备用区（io_uring完成驱动模式下为提供缓冲区）、再拷贝进in_buffer的字节数
+
+    // io_uring完成驱动模式：读写由请求的完成事件驱动，不使用_channel
+    UringPoller *_uring;                           // 事件监控器（nullptr表示按就绪事件处理）
+    std::unique_ptr<UringRequest> _recv_req;       // 多次触发的recv请求
+    std::unique_ptr<UringSendRequest> _send_req;   // sendmsg请求（文件分段发送不完时改为等待可写的poll请求）
+    bool _reading = false;                         // 是否在接收数据（相当于监控读事件）
+    bool _send_scheduled = false;                  // 发送任务是否已在任务队列中
+
+    // using ClosedCallback = std::function<void(Connection*)>;
+    // 防止多线程对连接Connection进行操作时，多次释放导致野指针错误，这里对外提供的接口用shared_ptr智能指针操作连接
+
+public:
+    // 组件内部使用的连接关闭回调（普通函数指针，owner为服务器对象）
+    using ServerClosedHook = void (*)(void *owner, const PtrConnection &conn);
+
+private:
+    PtrHandlers _handlers;                          // 外部回调函数表（服务器共享）
+    ServerClosedHook _server_closed_hook = nullptr; // 组件内部使用的连接关闭回调函数
+    void *_server = nullptr;                        // _server_closed_hook的参数
+
+private:
+    // 从socket读取一次数据到in_buffer中，返回读到的字节数（0表示暂时没有数据），-1表示出错或连接断开
+    ssize_t readSocket()
+    {
+        // 优先直接读进in_buffer写偏移之后的空闲空间，放不下的部分才溢出到栈上的备用区（备用区不清零）
+        char spill[65536];
+        // 缓冲区的空间在数据读完后已归还内存池，读之前重新取一块
+        _in_buffer.ensureStorage();
+        size_t tail = _in_buffer.tailWriteableBytes();
+        struct iovec iov[2];
+        iov[0].iov_base = _in_buffer.writePos();
+        iov[0].iov_len = tail;
+        iov[1].iov_base = spill;
+        iov[1].iov_len = sizeof(spill);
+        // 尾部空间已经不小于备用区时，就不需要备用区了
+        int iovcnt = tail < sizeof(spill) ? 2 : 1;
+        ssize_t ret = _socket.NonBlockRecvv(iov, iovcnt);
+        if (ret <= 0)
+        {
+            // 没有读到数据，空的缓冲区不占着内存块
+            if (_in_buffer.empty())
+            {
+                _in_buffer.clear();
+            }
+            return ret;
+        }
+        size_t direct = std::min((size_t)ret, tail);
+        _in_buffer.moveWriteIdx(direct);
+        if ((size_t)ret > direct)
+        {
+            // 溢出部分拷贝进in_buffer（会触发挪动数据或扩容）
+            _in_buffer.write(spill, ret - direct);
+        }
+        _direct_read_bytes += direct;
+        _spill_read_bytes += ret - direct;
+        return ret;
+    }
+
+    // 内部channel事件发生的回调函数
+    // 描述符可读事件发生
+    void handleRead()
+    {
+        // 1.把socket中的数据读到in_buffer中
+        // 水平触发：每次事件只读一次，没读完下次还会通知
+        // 边缘触发：一直读到EAGAIN，但单次事件最多读_event_budget字节，防止一个连接饿死同一个EventLoop上的其它连接
+        size_t total = 0;
+        while (true)
+        {
+            ssize_t ret = readSocket();
+            if (ret < 0)
+            {
+                DF_DEBUG("连接fd: %d 被挂断了, 尝试关闭连接", _socket.Fd());
+                // 读取失败，关闭连接
+                // shutdown();
+                handleClose();
+                return;
+            }
+            total += ret;
+            if (!_edge_triggered || ret == 0)
+            {
+                break;
+            }
+            if (total >= _event_budget)
+            {
+                // 预算用完了，数据可能还没读完，但边缘触发不会再次通知，放到任务队列中接着读
+                _looper->cacheTask(std::bind(&Connection::resumeRead, shared_from_this()));
+                break;
+            }
+        }
+
+        // 快速确认在内核进入延迟确认模式后失效，每次读到数据后重新打开
+        if (_quick_ack && total > 0)
+        {
+            _socket.SetQuickAck(true);
+        }
+
+        // 2.调用业务处理回调函数
+        if (_in_buffer.readableBytes() > 0)
+        {
+            onMessage();
+        }
+    }
+    // 描述符可写事件发生
+    void handleWrite()
+    {
+        DF_DEBUG("连接%d可写事件发生", _socket.Fd());
+        // 1.把out_queue中的分段写到socket中，直到EAGAIN或用完本次事件的字节预算
+        // 内存分段聚集写，每次系统调用最多IOV_MAX个分段；文件分段用sendfile发送
+        struct iovec iov[IOV_MAX];
+        size_t total = 0;
+        while (!_out_queue.empty())
+        {
+            if (total >= _event_budget)
+            {
+                // 预算用完了，水平触发下次还会通知；边缘触发则放到任务队列中接着写
+                if (_edge_triggered)
+                {
+                    _looper->cacheTask(std::bind(&Connection::resumeWrite, shared_from_this()));
+                }
+                return;
+            }
+
+            int file_fd;
+            off_t file_offset;
+            size_t file_len;
+            if (_out_queue.peekFile(&file_fd, &file_offset, &file_len))
+            {
+                size_t expect = std::min(file_len, (size_t)MAX_SENDFILE_LEN);
+                ssize_t ret = _socket.SendFile(file_fd, file_offset, expect);
+                if (ret < 0)
+                {
+                    handleClose();
+                    return;
+                }
+                _out_queue.consume(ret);
+                total += ret;
+                if ((size_t)ret < expect)
+                {
+                    break;
+                }
+                continue;
+            }
+
+            int iovcnt = _out_queue.peekIov(iov, IOV_MAX);
+            size_t expect = 0;
+            for (int i = 0; i < iovcnt; i++)
+            {
+                expect += iov[i].iov_len;
+            }
+            // 紧跟着文件分段时（如响应头之后是文件正文），带上MSG_MORE，让头部和文件开头合并成满包
+            ssize_t ret = _socket.NonBlockSendv(iov, iovcnt, _out_queue.isFileAt(iovcnt));
+            if (ret < 0)
+            {
+                // 写入失败，关闭连接
+                handleClose();
+                return;
+            }
+            // 2.数据写入成功，释放已发送的分段
+            _out_queue.consume(ret);
+            total += ret;
+            if ((size_t)ret < expect)
+            {
+                // 内核发送缓冲区已满，等待下一次可写事件
+                break;
+            }
+        }
+        afterWrite();
+    }
+    // 发送之后的处理
+    void afterWrite()
+    {
+        // 1.输出队列降到低水位以下时恢复读
+        checkLowWaterMark();
+        // 2.数据全部写入成功，关闭写事件监控
+        if (_out_queue.empty())
+        {
+            if (!_uring)
+            {
+                _channel.disableWrite();
+            }
+            // 通知使用者数据已全部发出（回调中可以继续发送）
+            PtrHandlers handlers = _handlers;
+            if (handlers && handlers->write_complete)
+            {
+                handlers->write_complete(shared_from_this());
+            }
+            // 如果当前连接是待关闭状态，则需要释放连接
+            if (_status == CLOSING && _out_queue.empty())
+            {
+                release();
+            }
+        }
+    }
+
+    // 读写监控的开关：按就绪事件处理时操作_channel，io_uring完成驱动模式下提交/撤销请求
+    void startReading()
+    {
+        if (!_uring)
+        {
+            if (!_channel.isReadAble())
+            {
+                _channel.enableRead();
+            }
+            return;
+        }
+        _reading = true;
+        // 撤销中的recv请求结束后会重新提交
+        if (!_recv_req->inflight)
+        {
+            _uring->submitRecv(_recv_req.get(), _socket.Fd());
+        }
+    }
+    void stopReading()
+    {
+        if (!_uring)
+        {
+            _channel.disableRead();
+            return;
+        }
+        _reading = false;
+        _uring->cancelRequest(_recv_req.get());
+    }
+    bool isReading()
+    {
+        return _uring ? _reading : _channel.isReadAble();
+    }
+    // 有数据待发送：io_uring完成驱动模式下放到任务队列中发送，同一轮入队的数据合并成一次sendmsg
+    void startWriting()
+    {
+        if (!_uring)
+        {
+            if (!_channel.isWriteAble())
+            {
+                _channel.enableWrite();
+            }
+            return;
+        }
+        if (!_send_scheduled && !_send_req->inflight)
+        {
+            _send_scheduled = true;
+            _looper->cacheTask(std::bind(&Connection::sendQueued, shared_from_this()));
+        }
+    }
+
+    // io_uring完成驱动模式下发送输出队列（同一时刻最多一个发送请求）
+    // 文件分段仍同步sendfile（io_uring没有对应的操作），发不完时等待可写；内存分段提交sendmsg，数据块在完成前保持引用
+    void sendQueued()
+    {
+        _send_scheduled = false;
+        if (_status == CLOSED || _send_req->inflight)
+        {
+            return;
+        }
+        int file_fd;
+        off_t file_offset;
+        size_t file_len;
+        while (_out_queue.peekFile(&file_fd, &file_offset, &file_len))
+        {
+            size_t expect = std::min(file_len, (size_t)MAX_SENDFILE_LEN);
+            ssize_t ret = _socket.SendFile(file_fd, file_offset, expect);
+            if (ret < 0)
+            {
+                handleClose();
+                return;
+            }
+            _out_queue.consume(ret);
+            if ((size_t)ret < expect)
+            {
+                _uring->submitPollOut(_send_req.get(), _socket.Fd());
+                return;
+            }
+        }
+        if (_out_queue.empty())
+        {
+            afterWrite();
+            return;
+        }
+        int iovcnt = _out_queue.pinIov(_send_req->iov, UringSendRequest::MAX_IOV, &_send_req->pinned);
+        memset(&_send_req->msg, 0, sizeof(_send_req->msg));
+        _send_req->msg.msg_iov = _send_req->iov;
+        _send_req->msg.msg_iovlen = iovcnt;
+        // 紧跟着文件分段时带上MSG_MORE，同handleWrite
+        int flags = MSG_NOSIGNAL | (_out_queue.isFileAt(iovcnt) ? MSG_MORE : 0);
+        _uring->submitSendmsg(_send_req.get(), _socket.Fd(), flags);
+    }
+    // 发送请求完成：sendmsg的res为发送的字节数，poll的res为就绪事件
+    void onSendComplete(int res, const char *, size_t, bool)
+    {
+        _send_req->pinned.clear();
+        if (res == -EAGAIN)
+        {
+            // 内核发送缓冲区已满
+            _uring->submitPollOut(_send_req.get(), _socket.Fd());
+            return;
+        }
+        if (res < 0)
+        {
+            DF_ERROR("Sendmsg to fd-%d failed: %s", _socket.Fd(), strerror(-res));
+            handleClose();
+            return;
+        }
+        if (_send_req->opcode == IORING_OP_SENDMSG)
+        {
+            _out_queue.consume(res);
+            checkLowWaterMark();
+        }
+        handleAny();
+        sendQueued();
+    }
+    // recv请求完成：data为提供缓冲区中的数据，拷贝进in_buffer后缓冲区立即归还
+    void onRecvComplete(int res, const char *data, size_t len, bool more)
+    {
+        if (res > 0)
+        {
+            _in_buffer.write(data, len);
+            _spill_read_bytes += len;
+            if (_quick_ack)
+            {
+                _socket.SetQuickAck(true);
+            }
+        }
+        else if (res == 0 || (res != -ENOBUFS && res != -ECANCELED))
+        {
+            // 对端关闭或出错（提供缓冲区用完、被撤销时不是连接的问题）
+            DF_DEBUG("连接fd: %d 被挂断了, 尝试关闭连接", _socket.Fd());
+            handleClose();
+            return;
+        }
+        // 多次触发的recv结束了（提供缓冲区用完、被撤销后又恢复接收），重新提交
+        if (!more && _reading)
+        {
+            _uring->submitRecv(_recv_req.get(), _socket.Fd());
+        }
+        // 暂停接收期间到达的数据留在in_buffer中，恢复时处理
+        if (_reading && res > 0)
+        {
+            onMessage();
+        }
+        handleAny();
+    }
+    // 入队后检查高水位：对端读得太慢，暂停读它的新数据（不再产生新的响应），通知使用者，开始慢消费者计时
+    void checkHighWaterMark()
+    {
+        if (_high_water_mark == 0 || _above_high_water || _out_queue.memoryBytes() < _high_water_mark)
+        {
+            return;
+        }
+        _above_high_water = true;
+        if (isReading())
+        {
+            stopReading();
+        }
+        if (_slow_evict_ms > 0)
+        {
+            _looper->addTimer(&_evict_timer, _slow_evict_ms, std::bind(&Connection::evictSlowConsumer, this));
+        }
+        PtrHandlers handlers = _handlers;
+        if (handlers && handlers->high_water_mark)
+        {
+            handlers->high_water_mark(shared_from_this(), _out_queue.memoryBytes());
+        }
+    }
+    // 发送后检查低水位：降到低水位以下时恢复读，取消慢消费者计时
+    void checkLowWaterMark()
+    {
+        if (_above_high_water && _out_queue.memoryBytes() <= _low_water_mark)
+        {
+            leaveHighWater();
+        }
+    }
+    // 退出高水位状态：取消慢消费者计时，恢复读，通知使用者（回调中可以继续发送）
+    // 业务处理在高水位时留在in_buffer中没有处理的数据，不会再有读事件通知，放到任务队列中接着处理
+    void leaveHighWater()
+    {
+        _above_high_water = false;
+        _looper->cancelTimer(&_evict_timer);
+        if (_status == CLOSED)
+        {
+            return;
+        }
+        startReading();
+        if (_in_buffer.readableBytes() > 0)
+        {
+            _looper->cacheTask(std::bind(&Connection::resumeMessage, shared_from_this()));
+        }
+        PtrHandlers handlers = _handlers;
+        if (handlers && handlers->low_water_mark)
+        {
+            handlers->low_water_mark(shared_from_this());
+        }
+    }
+    void resumeMessage()
+    {
+        if (_status == CLOSED || _above_high_water || _in_buffer.readableBytes() == 0)
+        {
+            return;
+        }
+        onMessage();
+    }
+    // 输出队列持续高于高水位超过_slow_evict_ms：丢弃待发送数据，关闭连接
+    void evictSlowConsumer()
+    {
+        if (_status == CLOSED || !_above_high_water)
+        {
+            return;
+        }
+        DF_WARN("连接%" PRIu64 "输出队列%zu字节持续高于高水位%ums, 关闭连接", _conn_id, _out_queue.memoryBytes(), _slow_evict_ms);
+        release();
+    }
+    // 边缘触发下，预算用完后在任务队列中继续读写
+    void resumeRead()
+    {
+        if (_status == CLOSED || !_channel.isReadAble())
+        {
+            return;
+        }
+        handleRead();
+    }
+    void resumeWrite()
+    {
+        if (_status == CLOSED || !_channel.isWriteAble())
+        {
+            return;
+        }
+        handleWrite();
+    }
+    // 描述符关闭事件发生
+    void handleClose()
+    {
+        // 看看读缓冲区有没有需要处理的数据，然后再关闭
+        if (_in_buffer.readableBytes() > 0)
+        {
+            onMessage();
+        }
+        release();
+    }
+    // 描述符错误事件发生
+    void handleError()
+    {
+        handleClose();
+    }
+    // 描述符任意事件发生
+    void handleAny()
+    {
+        // 刷新连接活跃度
+        if (_enable_inactive_close == true)
+        {
+            _looper->resetTimer(&_idle_timer);
+        }
+
+        // 调用组件使用者的任意事件回调函数
+        PtrHandlers handlers = _handlers;
+        if (handlers && handlers->any)
+        {
+            handlers->any(shared_from_this());
+        }
+    }
+
+    // 对于连接的所有操作，都应该在EventLoop所在的线程中进行
+    // 发送数据（拷贝进输出队列）
+    void sendInLoop(const char *data, size_t len)
+    {
+        if (_status == CLOSED)
+        {
+            return;
+        }
+        // 向缓冲区写入数据
+        _out_queue.append(data, len);
+        // 开启写事件监听
+        startWriting();
+        checkHighWaterMark();
+    }
+    // 发送数据（共享数据块，不拷贝）
+    void sendBlockInLoop(const OutputQueue::Block &block)
+    {
+        if (_status == CLOSED)
+        {
+            return;
+        }
+        _out_queue.append(block);
+        startWriting();
+        checkHighWaterMark();
+    }
+    // 发送文件内容（sendfile零拷贝）
+    void sendFileInLoop(const OutputQueue::FilePtr &file, size_t offset, size_t len)
+    {
+        if (_status == CLOSED)
+        {
+            return;
+        }
+        _out_queue.appendFile(file, offset, len);
+        startWriting();
+    }
+
+    // 停止连接（要先检查缓冲区中是否还有数据待处理，再关闭连接）
+    void shutdownInLoop()
+    {
+        // 连接已经释放（出错、超时等先于关闭任务执行），不能再回到CLOSING状态重复释放
+        if (_status == CLOSED)
+        {
+            return;
+        }
+        _status = CLOSING;
+        // 1.检查读缓冲区中是否还有数据待处理，有的话先处理完
+        if (_in_buffer.readableBytes() > 0)
+        {
+            DF_DEBUG("连接%d还有数据待处理, 先处理完再关闭", _socket.Fd());
+            onMessage();
+        }
+        // 2.检查写缓冲区中是否还有数据待发送
+        if (_out_queue.readableBytes() > 0)
+        {
+            DF_DEBUG("连接%d有数据待发送, 启动写事件监控", _socket.Fd());
+            // 有数据待发送，启动写事件监控，交给handleWrite发送完数据后再去关闭
+            startWriting();
+        }
+        else
+        {
+            DF_DEBUG("连接%d没有数据待发送, 直接关闭", _socket.Fd());
+            // 没有数据待发送，直接关闭
+            release();
+        }
+    }
+
+    // 释放连接（关闭连接）
+    void releaseInLoop()
+    {
+        // 超时关闭、出错关闭等可能先后排队，只释放一次
+        if (_status == CLOSED)
+        {
+            return;
+        }
+        // 0.设置连接状态为已关闭
+        _status = CLOSED;
+        // 1.移除描述符事件监控（io_uring完成驱动模式下释放请求，进行中的由事件监控器撤销后回收）
+        _looper->removeEvent(&_channel);
+        if (_uring)
+        {
+            _reading = false;
+            _uring->releaseRequest(_recv_req.release());
+            _uring->releaseRequest(_send_req.release());
+            _uring->submit();
+        }
+        // 2.关闭连接
+        _socket.Close();
+        // 输入缓冲区的空间在本线程归还给内存池（连接对象可能在其它线程析构）
+        _in_buffer.clear();
+        // 连接已关闭，待发送的数据不会再发出，同时从所在EventLoop的负载统计中减掉
+        _out_queue.clear();
+        // 3.如果开启了非活跃连接关闭，则取消
+        if (_enable_inactive_close == true)
+        {
+            disableInactiveCloseInLoop();
+        }
+        _looper->cancelTimer(&_evict_timer);
+        // 4.调用连接关闭回调函数（用户设定）
+        PtrHandlers handlers = _handlers;
+        if (handlers && handlers->closed)
+        {
+            handlers->closed(shared_from_this());
+        }
+        // 5.调用连接关闭回调函数（组件内部）
+        if (_server_closed_hook)
+        {
+            _server_closed_hook(_server, shared_from_this());
+        }
+    }
+    // 连接获取后，描述符的设置，组件内的连接真正建立
+    void establishedInLoop()
+    {
+        assert(_status == CONNECTING);
+        // 1.设置连接状态
+        _status = CONNECTED;
+        // 2.启动读事件监控
+        startReading();
+        // 3.调用连接建立回调函数（用户设定）
+        PtrHandlers handlers = _handlers;
+        if (handlers && handlers->connected)
+        {
+            handlers->connected(shared_from_this());
+        }
+    }
+    // 开启非活跃连接关闭
+    void enableInactiveCloseInLoop(int sec)
+    {
+        if (_enable_inactive_close == false)
+        {
+            _enable_inactive_close = true;
+        }
+        // 添加释放连接的定时任务（已经有定时器时，按新的超时时间重新计时）
+        _looper->addTimer(&_idle_timer, (uint64_t)sec * 1000, std::bind(&Connection::release, this));
+    }
+    // 取消非活跃连接关闭
+    void disableInactiveCloseInLoop()
+    {
+        _enable_inactive_close = false;
+        _looper->cancelTimer(&_idle_timer);
+    }
+    // 设置输出队列水位（按新水位立即检查一次）
+    void setWaterMarksInLoop(size_t high, size_t low)
+    {
+        _high_water_mark = high;
+        _low_water_mark = low;
+        if (high == 0)
+        {
+            // 关闭水位控制，暂停中的读恢复
+            if (_above_high_water)
+            {
+                leaveHighWater();
+            }
+            return;
+        }
+        checkHighWaterMark();
+        checkLowWaterMark();
+    }
+    void enableSlowConsumerEvictionInLoop(uint32_t ms)
+    {
+        _slow_evict_ms = ms;
+        if (ms == 0)
+        {
+            _looper->cancelTimer(&_evict_timer);
+        }
+    }
+    // 调用业务处理回调函数
+    // 先持有一份表的引用：回调中可能切换协议（替换表指针），旧表要活到回调返回
+    void onMessage()
+    {
+        PtrHandlers handlers = _handlers;
+        if (handlers && handlers->message)
+        {
+            handlers->message(shared_from_this(), _in_buffer);
+        }
+    }
+
+    // Channel的事件处理函数表，所有连接共用
+    static const ChannelHandlers *channelHandlers()
+    {
+        static const ChannelHandlers handlers = {
+            &ChannelHandlers::call<Connection, &Connection::handleRead>,
+            &ChannelHandlers::call<Connection, &Connection::handleWrite>,
+            &ChannelHandlers::call<Connection, &Connection::handleError>,
+            &ChannelHandlers::call<Connection, &Connection::handleClose>,
+            &ChannelHandlers::call<Connection, &Connection::handleAny>,
+        };
+        return &handlers;
+    }
+
+public:
+    Connection(EventLoop *looper, int sockfd, uint64_t conn_id)
+        : _conn_id(conn_id), _socket(sockfd), _status(CONNECTING), _channel(sockfd, looper), _in_buffer(looper->bufferPool()), _looper(looper), _enable_inactive_close(false), _uring(looper->uring())
+    {
+        // sendfile没有MSG_DONTWAIT这样的标志位，连接套接字需要设为非阻塞（Acceptor获取的连接已经是非阻塞的，这里兜底）
+        _socket.SetNonBlock();
+        // 待发送数据计入所在EventLoop的负载
+        _out_queue.setByteCounter(looper->queuedBytesCounter());
+        // 设置channel的事件处理函数（共享的静态表，不为每个连接创建回调对象）
+        _channel.setHandlers(channelHandlers(), this);
+        if (_uring)
+        {
+            _recv_req = std::make_unique<UringRequest>(&UringRequest::call<Connection, &Connection::onRecvComplete>, this);
+            _send_req = std::make_unique<UringSendRequest>(&UringRequest::call<Connection, &Connection::onSendComplete>, this);
+        }
+    }
+    ~Connection()
+    {
+        DF_DEBUG("Connection destructed, id: %" PRIu64, _conn_id);
+        // 没有经过releaseInLoop（EventLoop析构时还在的连接）的进行中请求，交给事件监控器回收
+        if (_recv_req && _recv_req->inflight)
+        {
+            _uring->releaseRequest(_recv_req.release());
+        }
+        if (_send_req && _send_req->inflight)
+        {
+            _uring->releaseRequest(_send_req.release());
+        }
+    }
+    int Fd() const // 获取连接的描述符
+    {
+        return _socket.Fd();
+    }
+    uint64_t Id() const // 获取连接的ID（高位是所属EventLoop的编号，见ConnectionSlots）
+    {
+        return _conn_id;
+    }
+    EventLoop *loop() const // 获取连接所绑定的事件循环
+    {
+        return _looper;
+    }
+    uint64_t directReadBytes() const // 直接读进读缓冲区的字节数（没有经过额外拷贝）
+    {
+        return _direct_read_bytes;
+    }
+    uint64_t spillReadBytes() const // 经备用区拷贝进读缓冲区的字节数
+    {
+        return _spill_read_bytes;
+    }
+    void setContext(const Any &context)
+    {
+        _context = context;
+    }
+    Any *getContext()
+    {
+        return &_context;
+    }
+    void send(const char *data, size_t len) // 发送数据（拷贝一份）
+    {
+        if (_looper->isInLoop())
+        {
+            sendInLoop(data, len);
+            return;
+        }
+        // 跨线程发送时，data的生命周期无法保证，先拷贝一份
+        send(std::string(data, len));
+    }
+    void send(std::string &&data) // 发送数据（接管字符串，不拷贝）
+    {
+        send(std::make_shared<const std::string>(std::move(data)));
+    }
+    void send(const OutputQueue::Block &block) // 发送共享的只读数据块（不拷贝，可同时发给多个连接）
+    {
+        _looper->runInLoop(std::bind(&Connection::sendBlockInLoop, this, block));
+    }
+    void sendFile(const OutputQueue::FilePtr &file, size_t offset, size_t len) // 发送文件的一段内容（sendfile，不经过用户态）
+    {
+        _looper->runInLoop(std::bind(&Connection::sendFileInLoop, this, file, offset, len));
+    }
+    void shutdown() // 关闭连接（并不实际关闭连接，需先判断缓冲区中是否还有数据）
+    {
+        _looper->runInLoop(std::bind(&Connection::shutdownInLoop, this));
+    }
+    void enableInactiveClose(int sec) // 启用连接空闲超时关闭
+    {
+        _looper->runInLoop(std::bind(&Connection::enableInactiveCloseInLoop, this, sec));
+    }
+    void disableInactiveClose() // 禁用连接空闲超时关闭
+    {
+        _looper->runInLoop(std::bind(&Connection::disableInactiveCloseInLoop, this));
+    }
+    // 设置输出队列的高/低水位（内存字节数，high为0表示不启用）
+    // 待发送数据达到high时暂停读并调用high_water_mark回调，发送到不超过low时恢复读
+    void setWaterMarks(size_t high, size_t low)
+    {
+        assert(high == 0 || low < high);
+        _looper->runInLoop(std::bind(&Connection::setWaterMarksInLoop, this, high, low));
+    }
+    // 输出队列持续高于高水位ms毫秒后关闭连接（慢消费者驱逐，0表示不驱逐）
+    void enableSlowConsumerEviction(uint32_t ms)
+    {
+        _looper->runInLoop(std::bind(&Connection::enableSlowConsumerEvictionInLoop, this, ms));
+    }
+    bool isAboveHighWaterMark() const // 输出队列是否处于高水位之上（读事件暂停中）
+    {
+        return _above_high_water;
+    }
+    bool isConnected() const // 连接是否处于已建立状态（没有在关闭中）
+    {
+        return _status == CONNECTED;
+    }
+    size_t inputBytes() const // 读缓冲区中还没有被业务处理的字节数
+    {
+        return _in_buffer.readableBytes();
+    }
+    size_t outputBytes() const // 输出队列中待发送的字节数
+    {
+        return _out_queue.readableBytes();
+    }
+    void discardInput() // 丢弃读缓冲区中还没有处理的数据（只能在EventLoop线程中调用，连接即将关闭、后面的数据已无效时使用）
+    {
+        _looper->assertInLoop();
+        _in_buffer.clear();
+    }
+    void resumeInput() // 在任务队列中重新处理读缓冲区中剩余的数据（业务暂停处理读到的数据、之后恢复时调用）
+    {
+        _looper->cacheTask(std::bind(&Connection::resumeMessage, shared_from_this()));
+    }
+
+    // 切换协议上下文，整体替换回调函数表（表可以由多个连接共享）
+    // 必须在EventLoop线程立即执行，防止放入任务队列后，新事件触发并先于upgradeContext处理，此时用的是旧的协议，不符合预期
+    void upgradeContext(const Any &context, PtrHandlers handlers)
+    {
+        _looper->assertInLoop();
+        _context = context;
+        _handlers = std::move(handlers);
+    }
+
+    // 释放连接（任务队列中执行，防止释放前进行业务处理）
+    // 任务持有连接：释放任务可能重复排队，第一个任务移除连接后，后面的任务仍要能看到CLOSED状态
+    void release()
+    {
+        _looper->cacheTask(std::bind(&Connection::releaseInLoop, shared_from_this()));
+    }
+    // 连接建立就绪后，对Channel进行设置，启动读事件监控，调用连接建立回调函数connected_cb
+    void established()
+    {
+        _looper->runInLoop(std::bind(&Connection::establishedInLoop, this));
+    }
+
+    void setHandlers(PtrHandlers handlers) // 设置外部回调函数表
+    {
+        _handlers = std::move(handlers);
+    }
+    const PtrHandlers &handlers() const // 获取外部回调函数表
+    {
+        return _handlers;
+    }
+    void setServerClosedHook(ServerClosedHook hook, void *server) // 设置组件内部使用的连接关闭回调函数
+    {
+        _server_closed_hook = hook;
+        _server = server;
+    }
+    // 使用边缘触发，单次读写事件最多处理budget字节（必须在established之前设置）
+    void enableEdgeTrigger(size_t budget = DEFAULT_EVENT_BUDGET)
+    {
+        assert(_status == CONNECTING);
+        _edge_triggered = true;
+        _event_budget = budget;
+        _channel.enableEdgeTrigger();
+    }
+    // 立即回复ACK，不使用延迟确认（必须在established之前设置）
+    void enableQuickAck()
+    {
+        assert(_status == CONNECTING);
+        _quick_ack = true;
+        _socket.SetQuickAck(true);
+    }
+};
+
+/*
+
+    Acceptor: 监听连接管理
+
+*/
+// 获取新连接的统计信息
+struct AcceptStats
+{
+    uint64_t accepted = 0;  // 获取到的连接数
+    uint64_t wakeups = 0;   // 监听套接字可读事件次数（accepted / wakeups 即平均每批获取的连接数）
+    uint64_t max_batch = 0; // 单次可读事件获取到的最多连接数
+    uint64_t rejected = 0;  // 描述符耗尽（EMFILE/ENFILE）时被直接关闭的连接数
+    uint64_t errors = 0;    // 其它可恢复的accept错误次数
+
+    AcceptStats &operator+=(const AcceptStats &other)
+    {
+        accepted += other.accepted;
+        wakeups += other.wakeups;
+        max_batch = std::max(max_batch, other.max_batch);
+        rejected += other.rejected;
+        errors += other.errors;
+        return *this;
+    }
+};
+
 class Acceptor
 {
-    using AcceptCallback = std::function<void(int fd)>;
+    using AcceptCallback = InplaceFunction<void(int fd)>;
+
+public:
+    static const size_t DEFAULT_ACCEPT_BATCH = 64; // 单次可读事件默认最多获取的连接数
+    static const uint64_t ACCEPT_RETRY_MS = 100;   // 描述符耗尽且没有预留描述符时，暂停监听的时长
+
+private:
+    Socket _listen_socket;             // 监听套接字
+    std::unique_ptr<Channel> _channel; // 事件管理，监听读事件
+    AcceptCallback _accept_cb;         // 收到新连接后的回调函数
+    EventLoop *_looper;                // 绑定的事件循环
+    size_t _accept_batch;              // 单次可读事件最多获取的连接数
+    int _idle_fd;                      // 预留的空闲描述符，描述符耗尽时用来接收并关闭新连接
+    TimerNode _retry_timer;            // 暂停监听后恢复的定时器
+
+    std::unique_ptr<UringRequest> _accept_req; // io_uring完成驱动模式下多次触发的accept请求（不使用_channel）
+
+    // 统计信息（在EventLoop线程中更新，其它线程读取）
+    std::atomic<uint64_t> _accepted{0};
+    std::atomic<uint64_t> _wakeups{0};
+    std::atomic<uint64_t> _max_batch{0};
+    std::atomic<uint64_t> _rejected{0};
+    std::atomic<uint64_t> _errors{0};
+
+private:
+    // 监听套接字可读事件发生的回调函数
+    // 一次事件循环获取多个新连接，直到EAGAIN或达到_accept_batch个
+    void handleRead()
+    {
+        if (_listen_socket.Fd() < 0)
+        {
+            // 同一轮事件处理中已经停止了监听
+            return;
+        }
+        _wakeups.fetch_add(1, std::memory_order_relaxed);
+        if (_idle_fd < 0)
+        {
+            // 上次没能占回预留描述符（被其它线程抢先用掉了），每次获取连接前重试
+            _idle_fd = openIdleFd();
+        }
+        uint64_t batch = 0;
+        while (batch < _accept_batch)
+        {
+            // 获取新连接的描述符
+            int newfd = _listen_socket.Accept();
+            if (newfd == -2)
+            {
+                // 已经没有新连接了
+                break;
+            }
+            if (newfd == -1)
+            {
+                if (handleAcceptError())
+                {
+                    continue;
+                }
+                break;
+            }
+            batch++;
+            // 调用用户设置的回调函数，对新连接进行处理
+            if (_accept_cb)
+            {
+                _accept_cb(newfd);
+            }
+        }
+        _accepted.fetch_add(batch, std::memory_order_relaxed);
+        if (batch > _max_batch.load(std::memory_order_relaxed))
+        {
+            _max_batch.store(batch, std::memory_order_relaxed);
+        }
+    }
+
+    // 处理accept错误，返回true表示可以继续获取连接
+    bool handleAcceptError()
+    {
+        int err = errno;
+        if (err == EMFILE || err == ENFILE)
+        {
+            // 描述符耗尽：连接留在全连接队列里会让监听套接字一直可读，事件循环空转
+            // 先释放预留的描述符，接收这个连接后立即关闭，再把预留描述符占回来
+            if (_idle_fd < 0)
+            {
+                // 没有预留描述符可以释放：暂停监听，稍后再试，防止水平触发的监听套接字让事件循环空转
+                DF_WARN("Accept failed: %s, no reserved fd, pause accepting for %" PRIu64 "ms", strerror(err), ACCEPT_RETRY_MS);
+                if (!_accept_req)
+                {
+                    _channel->disableRead();
+                }
+                _looper->addTimer(&_retry_timer, ACCEPT_RETRY_MS, std::bind(&Acceptor::resumeAccept, this));
+                return false;
+            }
+            DF_WARN("Accept failed: %s, reject a new connection", strerror(err));
+            close(_idle_fd);
+            _idle_fd = -1;
+            int fd = accept(_listen_socket.Fd(), NULL, NULL);
+            if (fd >= 0)
+            {
+                close(fd);
+                _rejected.fetch_add(1, std::memory_order_relaxed);
+            }
+            _idle_fd = openIdleFd();
+            return false;
+        }
+        if (err == ECONNABORTED || err == EPROTO || err == EPERM || err == ENOBUFS || err == ENOMEM)
+        {
+            // 单个连接出错或者暂时资源不足，不影响后续的连接
+            DF_ERROR("Accept new fd failed: %s", strerror(err));
+            _errors.fetch_add(1, std::memory_order_relaxed);
+            return err == ECONNABORTED || err == EPROTO || err == EPERM;
+        }
+        DF_FATAL("监听套接字异常: %s", strerror(err));
+        abort();
+    }
+
+    // io_uring完成驱动模式下accept请求的完成事件：每个完成事件是一个新连接（或一次错误）
+    // 请求结束（出错、内核终止多次触发）后重新提交，暂停监听期间由resumeAccept重新提交
+    void onAccept(int res, const char *, size_t, bool more)
+    {
+        if (_listen_socket.Fd() < 0)
+        {
+            if (res >= 0)
+            {
+                close(res);
+            }
+            return;
+        }
+        _wakeups.fetch_add(1, std::memory_order_relaxed);
+        if (_idle_fd < 0)
+        {
+            _idle_fd = openIdleFd();
+        }
+        if (res >= 0)
+        {
+            _accepted.fetch_add(1, std::memory_order_relaxed);
+            if (_max_batch.load(std::memory_order_relaxed) == 0)
+            {
+                _max_batch.store(1, std::memory_order_relaxed);
+            }
+            if (_accept_cb)
+            {
+                _accept_cb(res);
+            }
+        }
+        else if (res != -ECANCELED)
+        {
+            errno = -res;
+            handleAcceptError();
+        }
+        if (!more && !_retry_timer.linked() && _listen_socket.Fd() >= 0)
+        {
+            startAccepting();
+        }
+    }
+    void startAccepting()
+    {
+        if (!_accept_req)
+        {
+            // 开启读事件监控（开始新连接监听）
+            _channel->enableRead();
+        }
+        else if (!_accept_req->inflight)
+        {
+            _looper->uring()->submitAccept(_accept_req.get(), _listen_socket.Fd());
+        }
+    }
+
+    static int openIdleFd()
+    {
+        return open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    // 暂停结束，恢复监听（期间已经停止监听时不再恢复）
+    void resumeAccept()
+    {
+        if (_listen_socket.Fd() >= 0)
+        {
+            startAccepting();
+        }
+    }
+
+    void listenInLoop()
+    {
+        startAccepting();
+    }
+    void stopInLoop()
+    {
+        // 移除事件监控，关闭监听套接字（套接字已交接给其它进程时，内核中的套接字和其中排队的连接由对方继续持有）
+        _looper->cancelTimer(&_retry_timer);
+        _channel->remove();
+        if (_accept_req)
+        {
+            // 撤销后才到达的新连接由事件监控器直接关闭
+            UringPoller *uring = _looper->uring();
+            uring->releaseRequest(_accept_req.release());
+            uring->submit();
+        }
+        _listen_socket.Close();
+    }
+
+public:
+    // 创建监听套接字，reuse_port为true时开启SO_REUSEPORT，可以和其它Acceptor共享同一端口
+    Acceptor(uint32_t port, EventLoop *looper, AcceptCallback accept_cb, bool reuse_port = false,
+             int backlog = Socket::DEFAULT_BACKLOG, size_t accept_batch = DEFAULT_ACCEPT_BATCH)
+        : _accept_cb(std::move(accept_cb)), _looper(looper), _accept_batch(accept_batch), _idle_fd(openIdleFd())
+    {
+        bool ok = _listen_socket.CreateServer(port, "0.0.0.0", reuse_port, backlog);
+        assert(ok);
+        // 设置Channel
+        _channel = std::move(std::make_unique<Channel>(_listen_socket.Fd(), _looper));
+        // 设置读事件触发的回调函数
+        _channel->setReadCallback(std::bind(&Acceptor::handleRead, this));
+        if (_looper->uring())
+        {
+            _accept_req = std::make_unique<UringRequest>(&UringRequest::call<Acceptor, &Acceptor::onAccept>, this);
+        }
+    }
+    // 使用已经处于监听状态的套接字（如从旧进程交接过来的），Acceptor接管其所有权
+    Acceptor(int listen_fd, EventLoop *looper, AcceptCallback accept_cb, size_t accept_batch = DEFAULT_ACCEPT_BATCH)
+        : _listen_socket(listen_fd), _accept_cb(std::move(accept_cb)), _looper(looper), _accept_batch(accept_batch), _idle_fd(openIdleFd())
+    {
+        _listen_socket.SetNonBlock();
+        _channel = std::make_unique<Channel>(_listen_socket.Fd(), _looper);
+        _channel->setReadCallback(std::bind(&Acceptor::handleRead, this));
+        if (_looper->uring())
+        {
+            _accept_req = std::make_unique<UringRequest>(&UringRequest::call<Acceptor, &Acceptor::onAccept>, this);
+        }
+    }
+
+    // 开始监听新连接（事件监控只能在所绑定的EventLoop线程中操作）
+    void listen()
+    {
+        _looper->runInLoop(std::bind(&Acceptor::listenInLoop, this));
+    }
+    // 停止接受新连接，关闭监听套接字
+    void stop()
+    {
+        _looper->runInLoop(std::bind(&Acceptor::stopInLoop, this));
+    }
+
+    ~Acceptor()
+    {
+        if (_idle_fd >= 0)
+        {
+            close(_idle_fd);
+        }
+        // 没有stop就析构（EventLoop已经退出）时，进行中的accept请求交给事件监控器回收
+        if (_accept_req && _accept_req->inflight)
+        {
+            _looper->uring()->releaseRequest(_accept_req.release());
+        }
+    }
+
+    Socket &listenSocket()
+    {
+        return _listen_socket;
+    }
+    EventLoop *loop() const
+    {
+        return _looper;
+    }
+
+    // 获取统计信息（任意线程可调用）
+    AcceptStats stats() const
+    {
+        AcceptStats st;
+        st.accepted = _accepted.load(std::memory_order_relaxed);
+        st.wakeups = _wakeups.load(std::memory_order_relaxed);
+        st.max_batch = _max_batch.load(std::memory_order_relaxed);
+        st.rejected = _rejected.load(std::memory_order_relaxed);
+        st.errors = _errors.load(std::memory_order_relaxed);
+        return st;
+    }
+};
+
+/*
+
+    ListenerHandoff: 监听套接字交接（平滑重启）
+
+    - 旧进程在一个Unix域套接字地址上等待接替者，接替者连上后，用SCM_RIGHTS把所有监听套接字发过去
+    - 接替者直接在收到的套接字上accept（内核中是同一个套接字，全连接队列里的连接不会丢），开始监听后回复一个确认字节
+    - 旧进程收到确认后平滑停止（不再accept，处理完已有连接再退出）；接替者没有确认就断开时，旧进程继续服务
+
+*/
+class ListenerHandoff
+{
+    using FdsProvider = InplaceFunction<std::vector<int>()>;
+    using ConfirmedCallback = InplaceFunction<void()>;
+
+    static const uint32_t MAGIC = 0x46444f48;  // 消息头的标识
+    static const size_t MAX_FDS = 253;         // 一条消息最多传递的描述符个数（内核的SCM_MAX_FD）
+    static const int RECV_TIMEOUT_SEC = 5;     // 接替者等待旧进程发送套接字的超时时间
+    static const char CONFIRM_BYTE = 'K';      // 接替者的确认字节
+
+private:
+    EventLoop *_looper;                     // 绑定的事件循环
+    std::string _path;                      // 交接地址（Unix域套接字路径）
+    FdsProvider _fds;                       // 获取要交接的监听套接字
+    ConfirmedCallback _confirmed;           // 接替者确认后的回调函数
+    std::unique_ptr<Socket> _listen_socket; // 等待接替者的监听套接字
+    std::unique_ptr<Channel> _channel;      // _listen_socket的事件管理
+    std::unique_ptr<Socket> _peer;          // 正在交接的接替者连接
+    std::unique_ptr<Channel> _peer_channel; // _peer的事件管理（等待确认字节）
+
+private:
+    static bool FillAddress(const std::string &path, struct sockaddr_un *addr)
+    {
+        memset(addr, 0, sizeof(*addr));
+        addr->sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr->sun_path))
+        {
+            DF_ERROR("Handoff path invalid: %s", path.c_str());
+            return false;
+        }
+        memcpy(addr->sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    // 把描述符连同消息头（标识、个数）一起发送
+    static bool SendFds(int sockfd, const std::vector<int> &fds)
+    {
+        if (fds.empty() || fds.size() > MAX_FDS)
+        {
+            return false;
+        }
+        uint32_t header[2] = {MAGIC, (uint32_t)fds.size()};
+        struct iovec iov;
+        iov.iov_base = header;
+        iov.iov_len = sizeof(header);
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+        if (sendmsg(sockfd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(header))
+        {
+            DF_ERROR("Handoff send fds failed: %s", strerror(errno));
+            return false;
+        }
+        return true;
+    }
 
-private:
-    Socket _listen_socket;             // 监听套接字
-    std::unique_ptr<Channel> _channel; // 事件管理，监听读事件
-    AcceptCallback _accept_cb;         // 收到新连接后的回调函数
-    EventLoop *_looper;                // 绑定的事件循环
-private:
-    // 监听套接字可读事件发生的回调函数
-    void handleRead()
+    // 接替者连上来：发送监听套接字，等待确认（同一时间只和一个接替者交接）
+    void handleAccept()
     {
-        // 获取新连接的描述符
-        int newfd = _listen_socket.Accept();
-        if (newfd == -1)
+        int fd = accept4(_listen_socket->Fd(), NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
         {
-            DF_ERROR("监听套接字异常");
-            abort();
+            return;
+        }
+        if (_peer && _peer->Fd() >= 0)
+        {
+            DF_WARN("Handoff already in progress, reject another successor");
+            ::close(fd);
+            return;
+        }
+        if (!SendFds(fd, _fds()))
+        {
+            ::close(fd);
+            return;
+        }
+        DF_INFO("Handoff: listening sockets sent to successor, waiting for confirmation");
+        _peer = std::make_unique<Socket>(fd);
+        _peer_channel = std::make_unique<Channel>(fd, _looper);
+        _peer_channel->setReadCallback(std::bind(&ListenerHandoff::handlePeer, this));
+        _peer_channel->enableRead();
+    }
+    // 接替者的确认字节到达，或者接替者断开
+    void handlePeer()
+    {
+        char ack = 0;
+        ssize_t ret = recv(_peer->Fd(), &ack, 1, MSG_DONTWAIT);
+        if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            return;
+        }
+        // 正在这个Channel的事件处理中，只移除监控、关闭描述符，对象留到下一次交接时再替换
+        _peer_channel->remove();
+        _peer->Close();
+        if (ret != 1 || ack != CONFIRM_BYTE)
+        {
+            DF_WARN("Handoff: successor left without confirmation, keep serving");
+            return;
         }
-        // 调用用户设置的回调函数，对新连接进行处理
-        if (_accept_cb)
+        DF_INFO("Handoff: successor confirmed");
+        if (_confirmed)
         {
-            _accept_cb(newfd);
+            _confirmed();
         }
     }
 
 public:
-    Acceptor(uint32_t port, EventLoop *looper, const AcceptCallback &accept_cb)
-        : _accept_cb(accept_cb), _looper(looper)
+    // fds提供要交接的监听套接字，confirmed在接替者确认后调用（都在looper线程中执行）
+    ListenerHandoff(EventLoop *looper, const std::string &path, FdsProvider fds, ConfirmedCallback confirmed)
+        : _looper(looper), _path(path), _fds(std::move(fds)), _confirmed(std::move(confirmed))
     {
-        bool ok = _listen_socket.CreateServer(port);
-        assert(ok);
-        // 设置Channel
-        _channel = std::move(std::make_unique<Channel>(_listen_socket.Fd(), _looper));
-        // 设置读事件触发的回调函数
-        _channel->setReadCallback(std::bind(&Acceptor::handleRead, this));
-        // 开启读事件监控（开始新连接监听）
+    }
+
+    // 在交接地址上开始等待接替者（只能在looper线程中调用）
+    // 地址上原有的文件属于已经交接出监听套接字的旧进程，直接替换
+    bool listen()
+    {
+        _looper->assertInLoop();
+        struct sockaddr_un addr;
+        if (!FillAddress(_path, &addr))
+        {
+            return false;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            DF_ERROR("Handoff socket create failed: %s", strerror(errno));
+            return false;
+        }
+        _listen_socket = std::make_unique<Socket>(fd);
+        unlink(_path.c_str());
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(fd, 1) < 0)
+        {
+            DF_ERROR("Handoff listen on %s failed: %s", _path.c_str(), strerror(errno));
+            _listen_socket.reset();
+            return false;
+        }
+        _channel = std::make_unique<Channel>(fd, _looper);
+        _channel->setReadCallback(std::bind(&ListenerHandoff::handleAccept, this));
         _channel->enableRead();
+        return true;
+    }
+    // 不再等待接替者（只能在looper线程中调用，不删除地址文件，它可能已经属于接替者）
+    void close()
+    {
+        _looper->assertInLoop();
+        if (_channel)
+        {
+            _channel->remove();
+            _listen_socket->Close();
+        }
+    }
+
+    // 接替者：连接旧进程的交接地址，取得它的监听套接字，control_fd用于之后的确认
+    // 没有旧进程在等待交接时返回false
+    static bool Receive(const std::string &path, std::vector<int> *fds, int *control_fd)
+    {
+        struct sockaddr_un addr;
+        if (!FillAddress(path, &addr))
+        {
+            return false;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            DF_DEBUG("No predecessor at %s: %s", path.c_str(), strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        struct timeval tv = {RECV_TIMEOUT_SEC, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        uint32_t header[2] = {0, 0};
+        struct iovec iov;
+        iov.iov_base = header;
+        iov.iov_len = sizeof(header);
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * MAX_FDS));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        ssize_t ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        fds->clear();
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); ret > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int *data = (const int *)CMSG_DATA(cmsg);
+                fds->insert(fds->end(), data, data + count);
+            }
+        }
+        if (ret != (ssize_t)sizeof(header) || header[0] != MAGIC || header[1] != fds->size() || fds->empty())
+        {
+            DF_ERROR("Handoff receive from %s failed: %s", path.c_str(), ret < 0 ? strerror(errno) : "bad message");
+            for (int received : *fds)
+            {
+                ::close(received);
+            }
+            fds->clear();
+            ::close(fd);
+            return false;
+        }
+        *control_fd = fd;
+        return true;
+    }
+    // 接替者：已经开始在交接来的套接字上监听，通知旧进程可以停止了
+    static void Confirm(int control_fd)
+    {
+        char ack = CONFIRM_BYTE;
+        if (send(control_fd, &ack, 1, MSG_NOSIGNAL) != 1)
+        {
+            DF_WARN("Handoff confirm failed: %s", strerror(errno));
+        }
+        ::close(control_fd);
+    }
+    // 描述符是否是监听在port端口上的TCP套接字（校验交接来的套接字）
+    static bool IsListeningOn(int fd, uint16_t port)
+    {
+        int listening = 0;
+        socklen_t len = sizeof(listening);
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening ||
+            getsockname(fd, (struct sockaddr *)&addr, &addr_len) < 0)
+        {
+            return false;
+        }
+        if (addr.ss_family == AF_INET)
+        {
+            return ntohs(((struct sockaddr_in *)&addr)->sin_port) == port;
+        }
+        if (addr.ss_family == AF_INET6)
+        {
+            return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port) == port;
+        }
+        return false;
+    }
+};
+
+/*
+
+    CpuTopology: CPU拓扑（从sysfs读取），用于事件循环线程的放置
+
+*/
+struct CpuInfo
+{
+    int cpu;    // 逻辑CPU编号
+    int core;   // 物理核编号（同一插槽内唯一）
+    int socket; // 插槽编号
+    int node;   // NUMA节点编号
+};
+
+// 一个事件循环线程的放置位置
+struct ThreadPlacement
+{
+    std::vector<int> cpus; // 绑定的CPU（空表示不绑定）
+    int node = -1;         // 内存优先从这个NUMA节点分配（-1表示不设置）
+};
+
+class CpuTopology
+{
+public:
+    // 读取当前进程可用的CPU及其所属的物理核、插槽、NUMA节点（读不到的信息按单插槽、单节点处理）
+    static CpuTopology Detect()
+    {
+        CpuTopology topo;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        {
+            DF_WARN("sched_getaffinity failed: %s", strerror(errno));
+            return topo;
+        }
+        std::vector<int> node_of(CPU_SETSIZE, 0);
+        DIR *dir = opendir("/sys/devices/system/node");
+        if (dir)
+        {
+            struct dirent *ent;
+            while ((ent = readdir(dir)) != nullptr)
+            {
+                int node;
+                if (sscanf(ent->d_name, "node%d", &node) != 1)
+                {
+                    continue;
+                }
+                std::string list;
+                if (readFile(std::string("/sys/devices/system/node/") + ent->d_name + "/cpulist", &list))
+                {
+                    for (int cpu : ParseCpuList(list))
+                    {
+                        if (cpu < CPU_SETSIZE)
+                        {
+                            node_of[cpu] = node;
+                        }
+                    }
+                }
+            }
+            closedir(dir);
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+            {
+                continue;
+            }
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            CpuInfo info = {cpu, cpu, 0, node_of[cpu]};
+            std::string value;
+            if (readFile(base + "core_id", &value))
+            {
+                info.core = atoi(value.c_str());
+            }
+            if (readFile(base + "physical_package_id", &value))
+            {
+                info.socket = atoi(value.c_str());
+            }
+            topo._cpus.push_back(info);
+        }
+        return topo;
+    }
+
+    // 解析"0-3,8,10-11"格式的CPU列表
+    static std::vector<int> ParseCpuList(const std::string &list)
+    {
+        std::vector<int> cpus;
+        const char *p = list.c_str();
+        while (*p)
+        {
+            char *end;
+            long first = strtol(p, &end, 10);
+            if (end == p)
+            {
+                break;
+            }
+            long last = first;
+            p = end;
+            if (*p == '-')
+            {
+                last = strtol(p + 1, &end, 10);
+                p = end;
+            }
+            for (long cpu = first; cpu <= last; cpu++)
+            {
+                cpus.push_back((int)cpu);
+            }
+            while (*p == ',' || *p == '\n' || *p == ' ')
+            {
+                p++;
+            }
+        }
+        return cpus;
+    }
+    // 生成"0-3,8"格式的CPU列表
+    static std::string FormatCpuList(const std::vector<int> &cpus)
+    {
+        std::string out;
+        for (size_t i = 0; i < cpus.size();)
+        {
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            {
+                j++;
+            }
+            out += (out.empty() ? "" : ",") + std::to_string(cpus[i]);
+            if (j > i)
+            {
+                out += "-" + std::to_string(cpus[j]);
+            }
+            i = j + 1;
+        }
+        return out.empty() ? "-" : out;
+    }
+
+    const std::vector<CpuInfo> &cpus() const
+    {
+        return _cpus;
+    }
+    // 查找某个CPU的信息，不在可用CPU中时返回nullptr
+    const CpuInfo *find(int cpu) const
+    {
+        for (auto &info : _cpus)
+        {
+            if (info.cpu == cpu)
+            {
+                return &info;
+            }
+        }
+        return nullptr;
+    }
+    // 按物理核分组，每组是同一个核上的所有超线程
+    std::vector<std::vector<int>> physicalCores() const
+    {
+        std::vector<std::pair<std::pair<int, int>, std::vector<int>>> cores;
+        for (auto &info : _cpus)
+        {
+            auto key = std::make_pair(info.socket, info.core);
+            auto it = std::find_if(cores.begin(), cores.end(), [&](const std::pair<std::pair<int, int>, std::vector<int>> &c)
+                                   { return c.first == key; });
+            if (it == cores.end())
+            {
+                cores.push_back(std::make_pair(key, std::vector<int>{info.cpu}));
+            }
+            else
+            {
+                it->second.push_back(info.cpu);
+            }
+        }
+        std::vector<std::vector<int>> out;
+        for (auto &c : cores)
+        {
+            out.push_back(c.second);
+        }
+        return out;
+    }
+    // 按NUMA节点分组（只包含有可用CPU的节点），返回节点编号和节点上的CPU
+    std::vector<std::pair<int, std::vector<int>>> numaNodes() const
+    {
+        std::vector<std::pair<int, std::vector<int>>> nodes;
+        for (auto &info : _cpus)
+        {
+            auto it = std::find_if(nodes.begin(), nodes.end(), [&](const std::pair<int, std::vector<int>> &n)
+                                   { return n.first == info.node; });
+            if (it == nodes.end())
+            {
+                nodes.push_back(std::make_pair(info.node, std::vector<int>{info.cpu}));
+            }
+            else
+            {
+                it->second.push_back(info.cpu);
+            }
+        }
+        return nodes;
+    }
+    // 一组CPU所在的NUMA节点（跨节点时返回-1）
+    int nodeOf(const std::vector<int> &cpus) const
+    {
+        int node = -1;
+        for (int cpu : cpus)
+        {
+            const CpuInfo *info = find(cpu);
+            if (info == nullptr || (node >= 0 && info->node != node))
+            {
+                return -1;
+            }
+            node = info->node;
+        }
+        return node;
+    }
+    size_t nodeCount() const
+    {
+        return numaNodes().size();
+    }
+
+private:
+    static bool readFile(const std::string &path, std::string *out)
+    {
+        FILE *fp = fopen(path.c_str(), "r");
+        if (fp == nullptr)
+        {
+            return false;
+        }
+        char buf[256];
+        out->clear();
+        while (fgets(buf, sizeof(buf), fp))
+        {
+            *out += buf;
+        }
+        fclose(fp);
+        return true;
     }
+
+private:
+    std::vector<CpuInfo> _cpus; // 当前进程可用的CPU
 };
 
 /*
@@ -1550,17 +5708,69 @@ public:
 class LoopThread
 {
 private:
+    PollerBackend _backend;      // 事件监控后端
+    uint32_t _index;             // EventLoop编号
+    ThreadPlacement _placement;  // 线程放置位置
+    std::string _placement_info; // 实际的放置结果（线程内填写，getLoop返回后可读）
     EventLoop *_looper;
-    std::thread _thread;
     std::mutex _mtx;
     std::condition_variable _cond;
+    std::thread _thread; // 线程一创建就会用到上面的成员，须最后初始化
 
 private:
+    // 绑定CPU、设置内存分配策略（在创建EventLoop之前，之后本线程首次写入的内存都在本地节点上）
+    void applyPlacement()
+    {
+        if (!_placement.cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : _placement.cpus)
+            {
+                CPU_SET(cpu, &set);
+            }
+            if (sched_setaffinity(0, sizeof(set), &set) < 0)
+            {
+                DF_WARN("loop %u: bind cpus %s failed: %s", _index, CpuTopology::FormatCpuList(_placement.cpus).c_str(), strerror(errno));
+            }
+        }
+        if (_placement.node >= 0)
+        {
+            unsigned long mask = 1UL << _placement.node;
+            if (_placement.node >= (int)(sizeof(mask) * 8) ||
+                syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) < 0)
+            {
+                DF_WARN("loop %u: prefer numa node %d failed: %s", _index, _placement.node, strerror(errno));
+            }
+        }
+        // 记录实际结果：线程当前可运行的CPU、正在运行的CPU
+        cpu_set_t actual;
+        CPU_ZERO(&actual);
+        std::vector<int> cpus;
+        if (sched_getaffinity(0, sizeof(actual), &actual) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &actual))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        _placement_info = "cpus " + CpuTopology::FormatCpuList(cpus) +
+                          (_placement.cpus.empty() ? " (unbound)" : "") +
+                          ", running on cpu " + std::to_string(sched_getcpu()) +
+                          ", memory node " + (_placement.node >= 0 ? std::to_string(_placement.node) : std::string("default"));
+    }
+
     // 线程的入口函数
     void threadEntry()
     {
+        applyPlacement();
         // 定义局部looper，使其生命周期随LoopThread
-        EventLoop looper;
+        // （Poller的事件数组、缓冲区内存池、本线程创建的连接都在放置之后分配）
+        EventLoop looper(_backend);
+        looper.connections()->setLoopIndex(_index);
         // DF_DEBUG("新循环线程id: %d", std::this_thread::get_id());
         {
             std::unique_lock<std::mutex> lock(_mtx);
@@ -1574,7 +5784,8 @@ private:
 
 public:
     // 设置线程的入口函数
-    LoopThread() : _looper(nullptr), _thread(std::bind(&LoopThread::threadEntry, this)) {}
+    LoopThread(PollerBackend backend = EPOLL_BACKEND, uint32_t index = 0, const ThreadPlacement &placement = ThreadPlacement())
+        : _backend(backend), _index(index), _placement(placement), _looper(nullptr), _thread(std::bind(&LoopThread::threadEntry, this)) {}
     ~LoopThread() { _thread.join(); }
 
     // 外部获取EventLoop
@@ -1584,36 +5795,155 @@ public:
         // 因此这里加一个条件变量的等待，如果内部尚未实例化，阻塞等待
         EventLoop *looper = nullptr;
         {
-            std::unique_lock<std::mutex> lock(_mtx);
-            // 等待_looper实例化就绪
-            _cond.wait(lock, [this]
-                       { return this->_looper != nullptr; });
-            looper = _looper;
+            std::unique_lock<std::mutex> lock(_mtx);
+            // 等待_looper实例化就绪
+            _cond.wait(lock, [this]
+                       { return this->_looper != nullptr; });
+            looper = _looper;
+        }
+        return looper;
+    }
+    // 线程的实际放置结果（getLoop之后可读）
+    std::string placementInfo()
+    {
+        getLoop();
+        return _placement_info;
+    }
+};
+
+/*
+
+    LoopThreadPool: 事件循环线程池
+
+*/
+// 新连接分配EventLoop的策略
+typedef enum
+{
+    ASSIGN_ROUND_ROBIN,       // 轮转（默认）
+    ASSIGN_LEAST_CONNECTIONS, // 连接数最少的EventLoop
+    ASSIGN_POWER_OF_TWO,      // 随机取两个EventLoop，选综合负载（连接数、待发送字节数、忙碌时间）低的那个
+    ASSIGN_IP_HASH            // 按客户端IP哈希，同一客户端的连接固定落在同一个EventLoop
+} LoopAssignPolicy;
+
+// 事件循环线程的放置方式
+typedef enum
+{
+    PLACE_NONE,          // 不绑定，由调度器决定（默认）
+    PLACE_CPU_LIST,      // 第i个线程绑定到CPU列表中的第i个CPU（线程多于CPU时循环使用）
+    PLACE_PHYSICAL_CORE, // 每个物理核一个线程，绑定到该核的所有超线程
+    PLACE_NUMA_NODE      // 线程轮流分配到各个NUMA节点，绑定到节点内的所有CPU
+} LoopPlacement;
+
+class LoopThreadPool
+{
+private:
+    size_t _thread_count = 0;                      // 线程数量
+    size_t _rotate_idx = 0;                        // rr轮转索引
+    LoopAssignPolicy _policy = ASSIGN_ROUND_ROBIN; // 分配策略
+    uint64_t _rand_state = 0x9e3779b97f4a7c15ULL;  // 随机选择用的xorshift状态（只在分配线程中使用）
+    std::vector<LoopThread *> _threads;            // 管理所有的LoopThread线程对象
+    std::vector<EventLoop *> _loopers;             // 每个从属线程中Looper (_thread_count>0 时有用)
+    EventLoop *_base_looper = nullptr;             // 主线程Looper(_thread_count==0 时有用)
+    PollerBackend _backend;                        // 从属线程的事件监控后端
+    LoopPlacement _placement = PLACE_NONE;         // 线程放置方式
+    std::vector<int> _cpu_list;                    // PLACE_CPU_LIST使用的CPU列表
+
+private:
+    // 计算第i个线程的放置位置，绑定的CPU都在同一个NUMA节点上时，内存也优先从该节点分配
+    ThreadPlacement placementOf(const CpuTopology &topo, size_t i)
+    {
+        ThreadPlacement placement;
+        switch (_placement)
+        {
+        case PLACE_CPU_LIST:
+            if (!_cpu_list.empty())
+            {
+                placement.cpus.push_back(_cpu_list[i % _cpu_list.size()]);
+            }
+            break;
+        case PLACE_PHYSICAL_CORE:
+        {
+            std::vector<std::vector<int>> cores = topo.physicalCores();
+            if (!cores.empty())
+            {
+                placement.cpus = cores[i % cores.size()];
+            }
+            break;
+        }
+        case PLACE_NUMA_NODE:
+        {
+            std::vector<std::pair<int, std::vector<int>>> nodes = topo.numaNodes();
+            if (!nodes.empty())
+            {
+                placement.cpus = nodes[i % nodes.size()].second;
+            }
+            break;
+        }
+        case PLACE_NONE:
+        default:
+            break;
+        }
+        // 只有一个节点时不设置内存策略（默认就是本地分配）
+        if (!placement.cpus.empty() && topo.nodeCount() > 1)
+        {
+            placement.node = topo.nodeOf(placement.cpus);
+        }
+        return placement;
+    }
+
+    size_t random()
+    {
+        _rand_state ^= _rand_state << 13;
+        _rand_state ^= _rand_state >> 7;
+        _rand_state ^= _rand_state << 17;
+        return (size_t)_rand_state;
+    }
+    size_t leastConnections()
+    {
+        size_t best = 0;
+        size_t best_count = SIZE_MAX;
+        for (size_t i = 0; i < _loopers.size(); i++)
+        {
+            size_t count = _loopers[i]->load().connections;
+            if (count < best_count)
+            {
+                best = i;
+                best_count = count;
+            }
+        }
+        return best;
+    }
+    size_t powerOfTwoChoices()
+    {
+        size_t n = _loopers.size();
+        size_t a = random() % n;
+        if (n == 1)
+        {
+            return a;
         }
-        return looper;
+        // 第二个在其余的n-1个中选，保证两个不同
+        size_t b = (a + 1 + random() % (n - 1)) % n;
+        return _loopers[a]->load().score() <= _loopers[b]->load().score() ? a : b;
+    }
+    static size_t hashKey(uint32_t key)
+    {
+        // 把IP的各位打散，相邻地址不会落在相邻的EventLoop上
+        uint64_t h = key * 0x9e3779b97f4a7c15ULL;
+        return (size_t)(h >> 32);
     }
-};
-
-/*
-
-    LoopThreadPool: 事件循环线程池
 
-*/
-class LoopThreadPool
-{
-private:
-    size_t _thread_count = 0;           // 线程数量
-    size_t _rotate_idx = 0;             // rr轮转索引
-    std::vector<LoopThread *> _threads; // 管理所有的LoopThread线程对象
-    std::vector<EventLoop *> _loopers;  // 每个从属线程中Looper (_thread_count>0 时有用)
-    EventLoop *_base_looper = nullptr;  // 主线程Looper(_thread_count==0 时有用)
 public:
-    LoopThreadPool(EventLoop *base_looper) : _base_looper(base_looper) {}
-    ~LoopThreadPool() {}
+    LoopThreadPool(EventLoop *base_looper, PollerBackend backend = EPOLL_BACKEND) : _base_looper(base_looper), _backend(backend) {}
+    ~LoopThreadPool()
+    {
+        stop();
+    }
 
     // 设置线程数量
     void setThreadCount(size_t count)
     {
+        // 加上主线程，EventLoop编号不能超出连接ID中编号的位数
+        assert(count < ConnectionSlots::MAX_LOOPS);
         _thread_count = count;
     }
     // 启动所有线程
@@ -1624,101 +5954,408 @@ public:
             return;
         }
         // DF_DEBUG("线程数量: %d", _thread_count);
+        CpuTopology topo = CpuTopology::Detect();
         _threads.resize(_thread_count);
         _loopers.resize(_thread_count);
         for (size_t i = 0; i < _thread_count; i++)
         {
-            _threads[i] = new LoopThread;
+            // 编号0留给主线程的EventLoop
+            _threads[i] = new LoopThread(_backend, i + 1, placementOf(topo, i));
             _loopers[i] = _threads[i]->getLoop();
         }
+        if (_placement != PLACE_NONE)
+        {
+            std::string report = topologyReport();
+            DF_INFO("loop placement:\n%s", report.c_str());
+        }
+    }
+    // 停止所有线程：先通知所有事件循环退出，再逐个回收线程（之后不能再使用这些EventLoop）
+    void stop()
+    {
+        for (EventLoop *looper : _loopers)
+        {
+            looper->quit();
+        }
+        for (LoopThread *thread : _threads)
+        {
+            delete thread;
+        }
+        _threads.clear();
+        _loopers.clear();
+    }
+    // 设置线程放置方式（start之前设置），PLACE_CPU_LIST时cpus为CPU列表
+    void setPlacement(LoopPlacement placement, const std::vector<int> &cpus = std::vector<int>())
+    {
+        _placement = placement;
+        _cpu_list = cpus;
+    }
+    // 拓扑和各线程实际放置结果的报告（start之后调用）
+    std::string topologyReport()
+    {
+        CpuTopology topo = CpuTopology::Detect();
+        std::string report = "topology: " + std::to_string(topo.cpus().size()) + " cpus, " +
+                             std::to_string(topo.physicalCores().size()) + " physical cores, " +
+                             std::to_string(topo.nodeCount()) + " numa nodes\n";
+        for (auto &node : topo.numaNodes())
+        {
+            report += "  node " + std::to_string(node.first) + ": cpus " + CpuTopology::FormatCpuList(node.second) + "\n";
+        }
+        for (size_t i = 0; i < _threads.size(); i++)
+        {
+            report += "  loop " + std::to_string(i + 1) + ": " + _threads[i]->placementInfo() + "\n";
+        }
+        return report;
+    }
+    // 获取所有从属线程的EventLoop（没有从属线程时，只有主线程的EventLoop）
+    std::vector<EventLoop *> getLoops()
+    {
+        if (_thread_count == 0)
+        {
+            return std::vector<EventLoop *>{_base_looper};
+        }
+        return _loopers;
+    }
+    // 设置分配策略（start之前设置）
+    void setAssignPolicy(LoopAssignPolicy policy)
+    {
+        _policy = policy;
+    }
+    LoopAssignPolicy assignPolicy() const
+    {
+        return _policy;
     }
-    // 为用户分配一个EventLoop
-    EventLoop *assignLoop()
+    // 为一个新连接分配EventLoop（只在获取新连接的线程中调用），hash_key是客户端IP，ASSIGN_IP_HASH策略使用
+    // 分配结果登记到该EventLoop的待创建连接数中，紧接着的分配就能看到
+    EventLoop *assignLoop(uint32_t hash_key = 0)
     {
         if (_thread_count == 0)
         {
             // 如果是0个，单Reactor模型，连接获取和业务处理都在主线程的 EventLoop 中进行
+            _base_looper->connections()->expect();
             return _base_looper;
         }
-        EventLoop *looper = _loopers[_rotate_idx];
-        // DF_DEBUG("分配了Eventloop %d 号, %p", _rotate_idx, looper);
-
-        _rotate_idx = (_rotate_idx + 1) % _thread_count;
+        size_t idx = 0;
+        switch (_policy)
+        {
+        case ASSIGN_LEAST_CONNECTIONS:
+            idx = leastConnections();
+            break;
+        case ASSIGN_POWER_OF_TWO:
+            idx = powerOfTwoChoices();
+            break;
+        case ASSIGN_IP_HASH:
+            idx = hashKey(hash_key) % _thread_count;
+            break;
+        case ASSIGN_ROUND_ROBIN:
+        default:
+            idx = _rotate_idx;
+            _rotate_idx = (_rotate_idx + 1) % _thread_count;
+            break;
+        }
+        EventLoop *looper = _loopers[idx];
+        // DF_DEBUG("分配了Eventloop %d 号, %p", idx, looper);
+        looper->connections()->expect();
         return looper;
     }
 };
 
 class TcpServer
 {
+    static const uint32_t DRAIN_INTERVAL_MS = 10; // 平滑停止时检查、关闭空闲连接的间隔
+
+public:
+    static const uint32_t DEFAULT_DRAIN_MS = 5000; // 平滑停止时默认最多等待已有连接的时间
+
 private:
-    int _id = 100;          // 自增长的ID，用于连接编号和定时任务编号
-    EventLoop _base_looper; // 主线程的事件循环
-    Acceptor _acceptor;     // 监听连接管理 (在构造函数中实例化，因此初始化列表必须在_base_looper之后，才能确保能挂载到其上)
+    uint16_t _port;                      // 监听端口
+    EventLoop _base_looper;              // 主线程的事件循环
+    std::unique_ptr<Acceptor> _acceptor; // 监听连接管理（start时创建，挂载到_base_looper上）
+
+    bool _reuse_port = false;                                // 是否每个从属线程一个SO_REUSEPORT监听套接字
+    std::vector<struct sock_filter> _reuse_port_cbpf;        // SO_REUSEPORT组的CBPF分发程序（可选）
+    int _reuse_port_ebpf = -1;                               // SO_REUSEPORT组的EBPF分发程序描述符（可选）
+    std::vector<std::unique_ptr<Acceptor>> _shard_acceptors; // 每个从属线程自己的监听管理
 
-    LoopThreadPool _loop_pool;                        // 事件循环线程池
-    std::unordered_map<int, PtrConnection> _conn_map; // 连接管理
+    int _backlog = Socket::DEFAULT_BACKLOG;                // 监听队列长度
+    size_t _accept_batch = Acceptor::DEFAULT_ACCEPT_BATCH; // 单次可读事件最多获取的连接数
+
+    LoopThreadPool _loop_pool;        // 事件循环线程池
+    std::vector<EventLoop *> _loops; // 按编号索引的EventLoop（start时确定，之后只读，用于按连接ID查找）
 
     bool _enable_inactive_close = false; // 是否启用连接空闲超时关闭
     int _timeout = 0;                    // 连接空闲超时时间
 
-    using ConnectionCallback = std::function<void(const PtrConnection &)>;
-    using MessageCallback = std::function<void(const PtrConnection &, Buffer &)>;
-    ConnectionCallback _closed_cb;    // 连接关闭回调函数
-    ConnectionCallback _connected_cb; // 连接建立回调函数
-    ConnectionCallback _any_cb;       // 任意事件回调函数
-    MessageCallback _message_cb;      // 业务处理回调函数
+    bool _edge_triggered = false;                            // 新连接是否使用边缘触发
+    size_t _event_budget = Connection::DEFAULT_EVENT_BUDGET; // 单次读写事件最多处理的字节数
+
+    size_t _high_water_mark = 0; // 新连接输出队列的高水位（0表示不启用）
+    size_t _low_water_mark = 0;  // 新连接输出队列的低水位
+    uint32_t _slow_evict_ms = 0; // 慢消费者驱逐时间（毫秒，0表示不驱逐）
+
+    uint32_t _spin_us = 0;         // 事件循环忙轮询的空转预算（微秒，0表示不开启）
+    SocketOptions _socket_options; // 监听套接字和新连接的调优参数
+
+    std::atomic<bool> _draining{false};        // 是否已开始平滑停止
+    std::atomic<size_t> _running_acceptors{0}; // 平滑停止时还没停止的分片监听
+    uint64_t _drain_deadline = 0;              // 强制关闭剩余连接的时刻（主线程EventLoop的now()）
+    TimerId _drain_timer;                      // 定期关闭空闲连接的定时器
+    std::string _handoff_path;                 // 监听套接字交接地址（空表示不启用）
+    uint32_t _handoff_drain_ms = 0;            // 交接完成后处理已有连接的最长时间
+    std::unique_ptr<ListenerHandoff> _handoff; // 等待接替者
+
+    using ConnectionCallback = ConnectionHandlers::ConnectionCallback;
+    using MessageCallback = ConnectionHandlers::MessageCallback;
+    PtrHandlers _handlers = std::make_shared<const ConnectionHandlers>(); // 所有连接共享的回调函数表（只读，设置回调时整体替换）
+
 private:
-    // 新连接处理函数（设置为_acceptor的读回调）
+    // 新连接处理函数（设置为_acceptor的读回调），由线程池分配EventLoop
+    // 主线程只负责分配，连接对象在所分配的EventLoop线程中创建，连接表也只由该线程修改
     void acceptHandler(int newfd)
     {
+        uint32_t hash_key = 0;
+        if (_loop_pool.assignPolicy() == ASSIGN_IP_HASH)
+        {
+            hash_key = Socket::PeerAddressKey(newfd);
+        }
+        EventLoop *looper = _loop_pool.assignLoop(hash_key);
+        looper->runInLoop(std::bind(&TcpServer::newConnection, this, looper, newfd));
+    }
+
+    // 在looper线程中创建新连接（分片监听时，looper就是获取到新连接的从属线程，直接调用）
+    void newConnection(EventLoop *looper, int newfd)
+    {
+        looper->assertInLoop();
         DF_DEBUG("获取一个新连接描述符 newfd: %d", newfd);
-        // 1.创建一个新的连接对象conn
-        PtrConnection conn = std::make_shared<Connection>(_loop_pool.assignLoop(), newfd, _id++);
+        // 1.创建一个新的连接对象conn（连接由所在的EventLoop拥有，ID由它的连接表分配）
+        ConnectionSlots *slots = looper->connections();
+        uint64_t id = slots->allocate();
+        PtrConnection conn = std::make_shared<Connection>(looper, newfd, id);
         // 2.为新连接设置回调函数
-        // 事件发生时，在conn所在的EventLoop线程中执行
-        conn->setClosedCallback(_closed_cb);
-        conn->setConnectedCallback(_connected_cb);
-        conn->setAnyCallback(_any_cb);
-        conn->setMessageCallback(_message_cb);
-        // 需要删除服务器中的连接时，应该在base_loop中执行，确保线程安全
-        conn->setServerClosedCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+        // 事件发生时，在conn所在的EventLoop线程中执行，所有连接共享同一张回调函数表，只增加引用计数
+        conn->setHandlers(_handlers);
+        // 连接关闭时，在连接所在的线程中从连接表移除
+        conn->setServerClosedHook(&TcpServer::onConnectionClosed, this);
 
         // 3.是否开启非活跃连接自动关闭
         if (_enable_inactive_close == true)
         {
             conn->enableInactiveClose(_timeout);
         }
-        // 4.连接准备就绪，创建完成
+        // 是否使用边缘触发
+        if (_edge_triggered == true)
+        {
+            conn->enableEdgeTrigger(_event_budget);
+        }
+        // 其它套接字选项从监听套接字继承，只有快速确认需要连接自己设置
+        if (_socket_options.quick_ack)
+        {
+            conn->enableQuickAck();
+        }
+        // 输出队列的水位控制和慢消费者驱逐
+        if (_high_water_mark > 0)
+        {
+            conn->setWaterMarks(_high_water_mark, _low_water_mark);
+            conn->enableSlowConsumerEviction(_slow_evict_ms);
+        }
+        // 4.将新连接加入所在EventLoop的连接表（要在established之前，否则连接可能在加入前就已经关闭并移除了）
+        slots->attach(id, conn);
+        // 5.连接准备就绪，创建完成
         conn->established();
-        // 5.将新连接加入连接管理
-        _conn_map[conn->Id()] = conn;
     }
 
     // 移除连接（服务器内部，移除连接的最后一步）
-    // 连接Connection的本体保存由主EventLoop管理，因此只能在主EventLoop中移除，否则会出现线程安全问题
-    void removeConnection(const PtrConnection &conn)
+    // 连接关闭时已经在它所在的EventLoop线程中，直接从该线程的连接表移除，不经过主线程、不加锁
+    static void onConnectionClosed(void *, const PtrConnection &conn)
+    {
+        conn->loop()->connections()->erase(conn->Id());
+    }
+
+    // 修改回调函数表：拷贝一份新表再替换，已建立的连接继续使用原来的表
+    template <class Modify>
+    void updateHandlers(Modify modify)
+    {
+        auto handlers = std::make_shared<ConnectionHandlers>(*_handlers);
+        modify(*handlers);
+        _handlers = std::move(handlers);
+    }
+
+    // 每个EventLoop创建一个SO_REUSEPORT监听套接字，由内核分发新连接，各线程各自获取连接，不经过主线程
+    // inherited是从旧进程交接来的监听套接字，按顺序优先使用（保持在组中的下标），不够时再新建
+    void startShardAcceptors(std::vector<int> &inherited)
     {
-        _base_looper.runInLoop(std::bind(&TcpServer::removeConnectionInBaseLoop, this, conn));
+        // 所有监听套接字在当前线程依次创建，保证在SO_REUSEPORT组中的下标与EventLoop的顺序一致
+        std::vector<EventLoop *> loopers = _loop_pool.getLoops();
+        for (size_t i = 0; i < loopers.size(); i++)
+        {
+            EventLoop *looper = loopers[i];
+            auto cb = std::bind(&TcpServer::newConnection, this, looper, std::placeholders::_1);
+            if (i < inherited.size())
+            {
+                _shard_acceptors.emplace_back(std::make_unique<Acceptor>(inherited[i], looper, cb, _accept_batch));
+            }
+            else
+            {
+                _shard_acceptors.emplace_back(std::make_unique<Acceptor>(_port, looper, cb, true, _backlog, _accept_batch));
+            }
+        }
+        inherited.erase(inherited.begin(), inherited.begin() + std::min(inherited.size(), loopers.size()));
+        // 分发程序挂载到组内任意一个套接字上，对整个组生效
+        Socket &group = _shard_acceptors.front()->listenSocket();
+        if (!_reuse_port_cbpf.empty())
+        {
+            group.AttachReusePortCbpf(_reuse_port_cbpf);
+        }
+        else if (_reuse_port_ebpf >= 0)
+        {
+            group.AttachReusePortEbpf(_reuse_port_ebpf);
+        }
+        for (auto &acceptor : _shard_acceptors)
+        {
+            acceptor->listenSocket().ApplyListenOptions(_socket_options);
+            acceptor->listen();
+        }
     }
 
-    void removeConnectionInBaseLoop(const PtrConnection &conn)
+    // 平滑停止（主线程EventLoop中执行）
+    void stopInLoop(uint32_t drain_ms)
+    {
+        if (_draining.exchange(true))
+        {
+            return;
+        }
+        DF_INFO("服务器开始停止, 最多等待%u毫秒处理已有连接", drain_ms);
+        // 1.停止接受新连接，也不再等待接替者
+        if (_acceptor)
+        {
+            _acceptor->stop();
+        }
+        // 分片的监听在各自线程中停止，全部停止之后才能判断连接是否已经关完
+        _running_acceptors = _shard_acceptors.size();
+        for (auto &acceptor : _shard_acceptors)
+        {
+            Acceptor *raw = acceptor.get();
+            raw->loop()->runInLoop([this, raw]() {
+                raw->stop();
+                _running_acceptors.fetch_sub(1, std::memory_order_release);
+            });
+        }
+        if (_handoff)
+        {
+            _handoff->close();
+        }
+        // 2.定期关闭空闲的连接，直到所有连接都已关闭或者超时
+        _drain_deadline = _base_looper.now() + drain_ms;
+        _drain_timer = _base_looper.runEvery(DRAIN_INTERVAL_MS, std::bind(&TcpServer::drainTick, this));
+        drainTick();
+    }
+    void drainTick()
+    {
+        size_t remain = 0;
+        for (EventLoop *looper : _loops)
+        {
+            if (looper)
+            {
+                // 包括已分配、尚未创建的连接
+                remain += looper->load().connections;
+            }
+        }
+        uint64_t now = _base_looper.now();
+        bool accepting = _running_acceptors.load(std::memory_order_acquire) > 0;
+        if ((remain == 0 && !accepting) || now >= _drain_deadline + DRAIN_INTERVAL_MS * 100)
+        {
+            // 所有连接都已关闭（强制关闭后迟迟关不完时也不再等待）
+            finishStop(remain);
+            return;
+        }
+        bool expired = now >= _drain_deadline;
+        for (EventLoop *looper : _loops)
+        {
+            if (looper)
+            {
+                looper->runInLoop(std::bind(&TcpServer::drainLoop, looper, expired));
+            }
+        }
+    }
+    // 在各自的EventLoop线程中：关闭没有处理中数据的连接，超时后关闭所有连接
+    // 还没收到过数据的连接（刚建立，第一个请求可能马上就到）也等到超时，避免客户端发出请求后才被关闭
+    static void drainLoop(EventLoop *looper, bool expired)
+    {
+        looper->connections()->forEach([expired](const PtrConnection &conn) {
+            if (expired)
+            {
+                conn->release();
+            }
+            else if (conn->isConnected() && conn->inputBytes() == 0 && conn->outputBytes() == 0 &&
+                     conn->directReadBytes() + conn->spillReadBytes() > 0)
+            {
+                conn->shutdown();
+            }
+        });
+    }
+    // 停止并回收所有从属线程，再让主线程的事件循环退出，start随之返回
+    void finishStop(size_t remain)
     {
-        auto it = _conn_map.find(conn->Id());
-        if (it != _conn_map.end())
+        if (remain > 0)
         {
-            _conn_map.erase(it);
+            DF_WARN("服务器停止时仍有%zu个连接未关闭", remain);
         }
+        _base_looper.cancelTimer(_drain_timer);
+        _loop_pool.stop();
+        _base_looper.quit();
+        DF_INFO("服务器已停止");
     }
 
-    void runAfterInBaseLoop(int sec, const TimerTask::Task &cb)
+    // 交接给接替者的监听套接字
+    std::vector<int> listenFds()
+    {
+        std::vector<int> fds;
+        if (_acceptor)
+        {
+            fds.push_back(_acceptor->listenSocket().Fd());
+        }
+        for (auto &acceptor : _shard_acceptors)
+        {
+            fds.push_back(acceptor->listenSocket().Fd());
+        }
+        return fds;
+    }
+    // 从旧进程接过监听套接字（没有启用交接、没有旧进程时为空），control_fd用于之后的确认
+    std::vector<int> inheritListeners(int *control_fd)
     {
-        _base_looper.addTimer(_id++, sec, cb);
+        std::vector<int> fds;
+        *control_fd = -1;
+        if (_handoff_path.empty() || !ListenerHandoff::Receive(_handoff_path, &fds, control_fd))
+        {
+            return fds;
+        }
+        std::vector<int> valid;
+        for (int fd : fds)
+        {
+            if (ListenerHandoff::IsListeningOn(fd, _port))
+            {
+                valid.push_back(fd);
+            }
+            else
+            {
+                DF_WARN("Handoff: fd %d is not listening on port %u, ignored", fd, _port);
+                close(fd);
+            }
+        }
+        if (valid.empty())
+        {
+            // 没有可用的套接字，不确认，旧进程继续服务
+            close(*control_fd);
+            *control_fd = -1;
+            return valid;
+        }
+        DF_INFO("Handoff: inherited %zu listening sockets from %s", valid.size(), _handoff_path.c_str());
+        return valid;
     }
 
 public:
-    // 给一个端口号，创建Tcp服务器
-    TcpServer(uint16_t port)
-        : _loop_pool(&_base_looper), _acceptor(port, &_base_looper, std::bind(&TcpServer::acceptHandler, this, std::placeholders::_1))
+    // 给一个端口号，创建Tcp服务器，backend选择事件监控后端（所有事件循环一致）
+    TcpServer(uint16_t port, PollerBackend backend = EPOLL_BACKEND)
+        : _port(port), _base_looper(backend), _loop_pool(&_base_looper, backend)
     {
     }
 
@@ -1726,11 +6363,83 @@ public:
     {
         _loop_pool.setThreadCount(count);
     }
+    // 设置新连接分配EventLoop的策略（start之前设置，分片监听时由内核分发，不使用此策略）
+    void setAssignPolicy(LoopAssignPolicy policy)
+    {
+        _loop_pool.setAssignPolicy(policy);
+    }
+    // 设置从属线程的CPU/NUMA放置方式（start之前设置），PLACE_CPU_LIST时cpus为CPU列表
+    void setLoopPlacement(LoopPlacement placement, const std::vector<int> &cpus = std::vector<int>())
+    {
+        _loop_pool.setPlacement(placement, cpus);
+    }
+    // 开启事件循环的自适应忙轮询（start之前设置），spin_us为空转预算
+    // socket_busy_poll_us大于0时同时给监听套接字设置SO_BUSY_POLL，新连接继承
+    void enableBusyPoll(uint32_t spin_us, int socket_busy_poll_us = 0)
+    {
+        _spin_us = spin_us;
+        _socket_options.busy_poll_us = socket_busy_poll_us;
+    }
+    // 各EventLoop的忙轮询统计，下标是EventLoop编号（任意线程可调用，start之后可用）
+    std::vector<BusyPollStats> busyPollStats()
+    {
+        std::vector<BusyPollStats> stats;
+        for (EventLoop *looper : _loops)
+        {
+            stats.push_back(looper ? looper->busyPollStats() : BusyPollStats());
+        }
+        return stats;
+    }
+    // CPU拓扑和各从属线程的放置结果（start之后可用）
+    std::string topologyReport()
+    {
+        return _loop_pool.topologyReport();
+    }
+    // 各EventLoop的当前负载，下标是EventLoop编号（0号为主线程，任意线程可调用，start之后可用）
+    std::vector<LoopLoad> loopLoads()
+    {
+        std::vector<LoopLoad> loads;
+        for (EventLoop *looper : _loops)
+        {
+            loads.push_back(looper ? looper->load() : LoopLoad());
+        }
+        return loads;
+    }
 
-    void setMessageCallback(const MessageCallback &cb) { _message_cb = cb; }        // 设置业务处理回调函数
-    void setConnectedCallback(const ConnectionCallback &cb) { _connected_cb = cb; } // 设置连接建立回调函数
-    void setClosedCallback(const ConnectionCallback &cb) { _closed_cb = cb; }       // 设置连接关闭回调函数
-    void setAnyCallback(const ConnectionCallback &cb) { _any_cb = cb; }             // 设置任意事件回调函数
+    // 设置回调函数（start之前设置）
+    void setMessageCallback(const MessageCallback &cb) // 设置业务处理回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.message = cb; });
+    }
+    void setConnectedCallback(const ConnectionCallback &cb) // 设置连接建立回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.connected = cb; });
+    }
+    void setClosedCallback(const ConnectionCallback &cb) // 设置连接关闭回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.closed = cb; });
+    }
+    void setAnyCallback(const ConnectionCallback &cb) // 设置任意事件回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.any = cb; });
+    }
+    void setWriteCompleteCallback(const ConnectionCallback &cb) // 设置输出队列发送完毕回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.write_complete = cb; });
+    }
+    void setHighWaterMarkCallback(const ConnectionHandlers::HighWaterMarkCallback &cb) // 设置输出队列超过高水位回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.high_water_mark = cb; });
+    }
+    void setLowWaterMarkCallback(const ConnectionCallback &cb) // 设置输出队列降到低水位回调函数
+    {
+        updateHandlers([&](ConnectionHandlers &h) { h.low_water_mark = cb; });
+    }
+    // 获取所有连接共享的回调函数表（可以作为Connection::upgradeContext的参数基础）
+    const PtrHandlers &handlers() const
+    {
+        return _handlers;
+    }
 
     // 启用连接空闲超时关闭
     void enableInactiveClose(int sec)
@@ -1739,12 +6448,122 @@ public:
         _timeout = sec;
     }
 
-    // 添加一个定时任务到主循环线程中
-    // 用户设置的定时任务由主EventLoop管理，如果让其它线程设置，就会存在线程安全问题
-    // 因此这里只能在主EventLoop线程中设置
-    void runAfter(int sec, const TimerTask::Task &cb)
+    // 连接使用边缘触发（EPOLLET），每次事件读写到EAGAIN为止，单次事件最多处理budget字节
+    void enableEdgeTrigger(size_t budget = Connection::DEFAULT_EVENT_BUDGET)
+    {
+        _edge_triggered = true;
+        _event_budget = budget;
+    }
+    // 新连接的输出队列水位控制（start之前设置，见Connection::setWaterMarks）
+    // 待发送数据达到high字节时暂停读该连接，发送到不超过low字节时恢复
+    // evict_ms大于0时，持续高于高水位evict_ms毫秒的连接（慢消费者）被关闭
+    void setWaterMarks(size_t high, size_t low, uint32_t evict_ms = 0)
+    {
+        assert(high == 0 || low < high);
+        _high_water_mark = high;
+        _low_water_mark = low;
+        _slow_evict_ms = evict_ms;
+    }
+
+    // 设置监听套接字和新连接的调优参数（start之前设置，见SocketOptions）
+    // 会覆盖enableBusyPoll设置的SO_BUSY_POLL，两者同时使用时后设置的生效
+    void setSocketOptions(const SocketOptions &opts)
+    {
+        _socket_options = opts;
+    }
+    const SocketOptions &socketOptions() const
+    {
+        return _socket_options;
+    }
+
+    // 设置监听队列长度（start之前设置）
+    void setListenBacklog(int backlog)
+    {
+        _backlog = backlog;
+    }
+    // 设置单次可读事件最多获取的连接数（start之前设置）
+    void setAcceptBatch(size_t batch)
+    {
+        assert(batch > 0);
+        _accept_batch = batch;
+    }
+    // 获取新连接的统计信息（所有监听套接字汇总）
+    AcceptStats acceptStats() const
+    {
+        AcceptStats st;
+        if (_acceptor)
+        {
+            st += _acceptor->stats();
+        }
+        for (auto &acceptor : _shard_acceptors)
+        {
+            st += acceptor->stats();
+        }
+        return st;
+    }
+
+    // 获取缓冲区内存池的统计信息（所有事件循环汇总）
+    BufferPoolStats bufferPoolStats()
     {
-        _base_looper.runInLoop(std::bind(&TcpServer::runAfterInBaseLoop, this, sec, cb));
+        BufferPoolStats st;
+        std::vector<EventLoop *> loops = _loop_pool.getLoops();
+        if (std::find(loops.begin(), loops.end(), &_base_looper) == loops.end())
+        {
+            loops.push_back(&_base_looper);
+        }
+        for (auto looper : loops)
+        {
+            st += looper->bufferPool()->stats();
+        }
+        return st;
+    }
+
+    // 每个从属线程一个SO_REUSEPORT监听套接字，各自获取新连接（不再由主线程获取后分发）
+    void enableReusePort()
+    {
+        _reuse_port = true;
+    }
+    // 设置SO_REUSEPORT组的CBPF分发程序，如Socket::CpuSteeringProgram(线程数)
+    void setReusePortProgram(const std::vector<struct sock_filter> &prog)
+    {
+        _reuse_port_cbpf = prog;
+    }
+    // 设置SO_REUSEPORT组的EBPF分发程序（由调用者加载，传入程序描述符）
+    void setReusePortProgram(int ebpf_prog_fd)
+    {
+        _reuse_port_ebpf = ebpf_prog_fd;
+    }
+
+    // 按ID查找连接（任意线程，无锁；start之后可用），连接已关闭时返回空
+    // 返回的连接只能通过send/shutdown等跨线程安全的接口操作
+    PtrConnection findConnection(uint64_t id)
+    {
+        uint32_t index = ConnectionSlots::loopIndexOf(id);
+        if (index >= _loops.size() || _loops[index] == nullptr)
+        {
+            return PtrConnection();
+        }
+        return _loops[index]->connections()->find(id);
+    }
+    // 当前连接总数（各EventLoop的连接数之和，任意线程可读）
+    size_t connectionCount()
+    {
+        size_t count = 0;
+        for (EventLoop *looper : _loops)
+        {
+            if (looper)
+            {
+                count += looper->connections()->size();
+            }
+        }
+        return count;
+    }
+
+    // 添加一个定时任务到主循环线程中（sec秒后执行，任意线程可调用，返回的句柄可用于取消）
+    // 需要毫秒精度或周期任务时，直接使用EventLoop的runAfter/runEvery/runAt
+    TimerId runAfter(int sec, EventLoop::TimerCallback cb)
+    {
+        return _base_looper.runAfter((uint64_t)sec * 1000, std::move(cb));
     }
 
     void start()
@@ -1752,9 +6571,88 @@ public:
         DF_DEBUG("服务器启动");
         // 设置并启动从属线程池 (必须设置过数量后)
         _loop_pool.start();
-        // 启动主线程的事件循环
+        // 按编号记录所有EventLoop（主线程为0号，从属线程从1开始）
+        _loops.assign(1, &_base_looper);
+        for (EventLoop *looper : _loop_pool.getLoops())
+        {
+            uint32_t index = looper->connections()->loopIndex();
+            if (index >= _loops.size())
+            {
+                _loops.resize(index + 1, nullptr);
+            }
+            _loops[index] = looper;
+        }
+        if (_spin_us > 0)
+        {
+            for (EventLoop *looper : _loops)
+            {
+                if (looper)
+                {
+                    looper->setBusyPoll(_spin_us);
+                }
+            }
+        }
+        // 开始监听新连接（启用了交接时，优先使用旧进程交接过来的监听套接字）
+        int handoff_control = -1;
+        std::vector<int> inherited = inheritListeners(&handoff_control);
+        if (_reuse_port)
+        {
+            startShardAcceptors(inherited);
+        }
+        else
+        {
+            auto cb = std::bind(&TcpServer::acceptHandler, this, std::placeholders::_1);
+            if (!inherited.empty())
+            {
+                _acceptor = std::make_unique<Acceptor>(inherited.front(), &_base_looper, cb, _accept_batch);
+                inherited.erase(inherited.begin());
+            }
+            else
+            {
+                _acceptor = std::make_unique<Acceptor>(_port, &_base_looper, cb, false, _backlog, _accept_batch);
+            }
+            _acceptor->listenSocket().ApplyListenOptions(_socket_options);
+            _acceptor->listen();
+        }
+        // 多出来的套接字（旧进程的分片比本进程多）用不上，关闭（其中排队的连接由旧进程在停止前处理）
+        for (int fd : inherited)
+        {
+            close(fd);
+        }
+        // 监听套接字都已就绪，通知旧进程可以停止了；再开始等待自己的接替者
+        if (handoff_control >= 0)
+        {
+            ListenerHandoff::Confirm(handoff_control);
+        }
+        if (!_handoff_path.empty())
+        {
+            _handoff = std::make_unique<ListenerHandoff>(&_base_looper, _handoff_path, std::bind(&TcpServer::listenFds, this),
+                                                         std::bind(&TcpServer::stop, this, _handoff_drain_ms));
+            _handoff->listen();
+        }
+        // 启动主线程的事件循环（stop之后返回）
         _base_looper.start();
     }
+    // 平滑停止（任意线程可调用）：停止接受新连接，等待已有连接处理完（最多drain_ms毫秒，之后强制关闭），
+    // 然后停止并回收所有从属线程，start返回。停止之后不能再使用这个服务器的连接和EventLoop
+    void stop(uint32_t drain_ms = DEFAULT_DRAIN_MS)
+    {
+        // 放到任务队列中，避免在事件处理中途关闭监听套接字
+        _base_looper.cacheTask(std::bind(&TcpServer::stopInLoop, this, drain_ms));
+    }
+    // 是否已开始平滑停止（任意线程可调用，协议层可以据此不再保持长连接）
+    bool isDraining() const
+    {
+        return _draining.load(std::memory_order_acquire);
+    }
+    // 启用监听套接字交接（start之前设置），实现不停机重启：
+    // start时如果path上有旧进程在等待交接，直接接过它的监听套接字；之后在path上等待接替者，
+    // 接替者确认接管后本进程平滑停止（最多等待drain_ms毫秒处理已有连接）
+    void enableHandoff(const std::string &path, uint32_t drain_ms = DEFAULT_DRAIN_MS)
+    {
+        _handoff_path = path;
+        _handoff_drain_ms = drain_ms;
+    }
 };
 
 void Channel::update()
@@ -1767,22 +6665,47 @@ void Channel::remove()
     _looper->removeEvent(this);
 }
 
-// TimerWheel创建一个定时任务
-void TimerWheel::addTimer(int id, int timeout, const TimerTask::Task &cb)
+PtrConnection ConnectionSlots::sharedFrom(Connection *raw)
+{
+    return raw->shared_from_this();
+}
+
+// TimerWheel创建一个定时任务（从节点池取一个节点，到EventLoop线程中加入时间轮）
+TimerId TimerWheel::addTimer(uint64_t delay, uint64_t interval, Task cb)
 {
-    _looper->runInLoop(std::bind(&TimerWheel::addTimerInLoop, this, id, timeout, cb));
+    TimerNode *node = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(_pool_mtx);
+        if (_free_nodes.empty())
+        {
+            _nodes.emplace_back();
+            node = &_nodes.back();
+            node->_index = _nodes.size() - 1;
+        }
+        else
+        {
+            node = &_nodes[_free_nodes.back()];
+            _free_nodes.pop_back();
+        }
+    }
+    node->_timeout = delay;
+    node->_interval = interval;
+    node->_callback = std::move(cb);
+    TimerId id(node->_index, node->_gen);
+    _looper->runInLoop(std::bind(&TimerWheel::addTimerInLoop, this, id._index, id._gen, delay));
+    return id;
 }
 
 // TimerWheel重置一个定时任务
-void TimerWheel::resetTimer(int id)
+void TimerWheel::resetTimer(TimerId id)
 {
     _looper->runInLoop(std::bind(&TimerWheel::resetTimerInLoop, this, id));
 }
 
 // TimerWheel取消一个定时任务
-void TimerWheel::cancelTimer(int id)
+void TimerWheel::cancelTimer(TimerId id)
 {
-    _looper->runInLoop(std::bind(&TimerWheel::cancelTimerInloop, this, id));
+    _looper->runInLoop(std::bind(&TimerWheel::cancelTimerInLoop, this, id));
 }
 
 // TODO
@@ -0,0 +1,130 @@
+#include "../src/server.hh"
+#include "alloc_counter.hh"
+
+// 用全局operator new的调用次数衡量任务投递和一次请求往返各分配了多少次内存
+
+static const uint16_t PORT = 8899;
+
+// 跨线程投递任务：每个任务捕获几个指针和整数（超出std::function的小对象缓冲区）
+static void benchTasks(EventLoop *looper, int count)
+{
+    std::atomic<int> done(0);
+    int a = 1, b = 2;
+    uint64_t before = g_allocs.load();
+    for (int i = 0; i < count; i++)
+    {
+        looper->runInLoop([&done, &a, &b, i]() {
+            if (a + b + i >= 0)
+            {
+                done.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    while (done.load() < count)
+    {
+        usleep(1000);
+    }
+    uint64_t allocs = g_allocs.load() - before;
+    printf("runInLoop (cross thread): %d tasks, %" PRIu64 " allocations, %.2f per task\n",
+           count, allocs, (double)allocs / count);
+}
+
+// 回显服务器上的请求往返：客户端发送一条消息，等待完整回显
+static void benchEcho(int conns, int rounds)
+{
+    std::vector<Socket> clients(conns);
+    for (auto &cli : clients)
+    {
+        cli.Create();
+        cli.Connect("127.0.0.1", PORT);
+    }
+    const std::string msg(64, 'x');
+    char buf[64];
+    // 先跑一轮预热，让连接建立完成、缓冲池里有可复用的块
+    for (int r = 0; r < 2 * rounds; r++)
+    {
+        if (r == rounds)
+        {
+            g_allocs.store(0);
+        }
+        for (auto &cli : clients)
+        {
+            cli.Send(msg.c_str(), msg.size());
+        }
+        for (auto &cli : clients)
+        {
+            size_t got = 0;
+            while (got < msg.size())
+            {
+                ssize_t ret = cli.Recv(buf, sizeof(buf) - got);
+                if (ret <= 0)
+                {
+                    DF_ERROR("echo recv failed");
+                    abort();
+                }
+                got += ret;
+            }
+        }
+    }
+    uint64_t allocs = g_allocs.load();
+    long requests = (long)conns * rounds;
+    printf("echo round trip: %ld requests, %" PRIu64 " allocations, %.2f per request\n",
+           requests, allocs, (double)allocs / requests);
+}
+
+// 建立连接、完成一次往返后关闭：统计服务端为每个新连接设置回调、投递任务产生的分配
+static void benchConnect(int conns)
+{
+    const std::string msg(64, 'x');
+    char buf[64];
+    uint64_t before = g_allocs.load();
+    for (int i = 0; i < conns; i++)
+    {
+        Socket cli;
+        cli.Create();
+        cli.Connect("127.0.0.1", PORT);
+        cli.Send(msg.c_str(), msg.size());
+        size_t got = 0;
+        while (got < msg.size())
+        {
+            ssize_t ret = cli.Recv(buf, sizeof(buf) - got);
+            if (ret <= 0)
+            {
+                DF_ERROR("echo recv failed");
+                abort();
+            }
+            got += ret;
+        }
+    }
+    usleep(200 * 1000); // 等服务端释放完所有连接
+    uint64_t allocs = g_allocs.load() - before;
+    printf("connection setup + 1 echo + close: %d connections, %" PRIu64 " allocations, %.2f per connection\n",
+           conns, allocs, (double)allocs / conns);
+}
+
+int main(int argc, char *argv[])
+{
+    int tasks = argc > 1 ? atoi(argv[1]) : 1000000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20000;
+    // 用法: ./alloc_bench [任务数] [每个连接的往返次数]
+
+    LoopThread loop_thread;
+    benchTasks(loop_thread.getLoop(), tasks);
+
+    std::thread server_thread([]() {
+        TcpServer server(PORT);
+        server.setThreadCount(1);
+        server.setMessageCallback([](const PtrConnection &conn, Buffer &buf) {
+            size_t len = buf.readableBytes();
+            conn->send((const char *)buf.readPos(), len);
+            buf.moveReadIdx(len);
+        });
+        server.start();
+    });
+    usleep(200 * 1000);
+    benchEcho(4, rounds);
+    benchConnect(2000);
+
+    fflush(stdout);
+    _exit(0);
+}
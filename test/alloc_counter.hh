@@ -0,0 +1,28 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// 统计全局operator new的调用次数（基准测试用，替换了全局operator new/delete，每个程序只能有一个源文件包含）
+static std::atomic<uint64_t> g_allocs(0);
+
+// 分配和释放都不内联：内联后编译器会看到new出来的指针被free释放，误报-Wmismatched-new-delete
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,164 @@
+#include "../src/server.hh"
+#include <algorithm>
+#include <netinet/tcp.h>
+
+// 新连接分配策略在偏斜负载下的尾延迟对比
+// 每8个连接中有1个“重”连接（每10ms发一个请求，每个请求占住EventLoop heavy_us微秒）
+// 按轮转分配时，重连接全部和一部分轻连接落在同一个EventLoop上，测量轻连接（立即回显）的往返延迟分布
+// 重请求用usleep模拟阻塞的业务处理（占住事件循环但不占CPU），结果不受机器核数影响；传入spin改为忙等
+// 用法: ./assign_bench [每个策略的测量秒数] [重请求耗时us] [spin]
+
+static const uint16_t BASE_PORT = 8900;
+static const int LOOPS = 4;
+static const int CONNS = 32;
+static const int HEAVY_EVERY = 2 * LOOPS; // 每隔多少个连接有一个重连接
+static const int HEAVY_INTERVAL_US = 10000; // 重连接的请求间隔
+
+static bool g_spin = false;
+
+static void holdLoop(int us)
+{
+    if (!g_spin)
+    {
+        usleep(us);
+        return;
+    }
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+// 客户端连接，从127.0.0.x发起（IP哈希策略需要不同的客户端地址）
+static int connectFrom(int host, uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(0x7f000000 | host);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+    {
+        DF_ERROR("bind 127.0.0.%d failed: %s", host, strerror(errno));
+        abort();
+    }
+    struct sockaddr_in svr = {};
+    svr.sin_family = AF_INET;
+    svr.sin_port = htons(port);
+    svr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&svr, sizeof(svr)) < 0)
+    {
+        DF_ERROR("connect failed: %s", strerror(errno));
+        abort();
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static bool roundTrip(int fd, char tag)
+{
+    char c = tag;
+    if (send(fd, &c, 1, 0) != 1)
+    {
+        return false;
+    }
+    return recv(fd, &c, 1, 0) == 1;
+}
+
+static void runPolicy(const char *name, LoopAssignPolicy policy, uint16_t port, int seconds, int heavy_us)
+{
+    TcpServer *server = nullptr;
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::thread([&]() {
+        TcpServer svr(port);
+        svr.setThreadCount(LOOPS);
+        svr.setAssignPolicy(policy);
+        svr.setMessageCallback([heavy_us](const PtrConnection &conn, Buffer &buf) {
+            size_t len = buf.readableBytes();
+            if (*buf.readPos() == 'H')
+            {
+                holdLoop(heavy_us * len);
+            }
+            conn->send((const char *)buf.readPos(), len);
+            buf.moveReadIdx(len);
+        });
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            server = &svr;
+            cond.notify_all();
+        }
+        svr.start();
+    }).detach();
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [&]() { return server != nullptr; });
+    }
+    usleep(100 * 1000);
+
+    // 建立连接：重连接一建立就开始持续发请求，轻连接之后再测量
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> heavy_threads;
+    std::vector<int> light;
+    for (int i = 0; i < CONNS; i++)
+    {
+        int fd = connectFrom(i + 1, port);
+        if (i % HEAVY_EVERY == 0)
+        {
+            heavy_threads.emplace_back([fd, &stop]() {
+                while (!stop && roundTrip(fd, 'H'))
+                {
+                    usleep(HEAVY_INTERVAL_US);
+                }
+            });
+        }
+        else
+        {
+            light.push_back(fd);
+        }
+        usleep(30 * 1000); // 给负载统计留出时间（忙碌时间按100ms周期统计）
+    }
+
+    std::vector<double> samples;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    for (size_t i = 0; std::chrono::steady_clock::now() < end; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!roundTrip(light[i % light.size()], 'L'))
+        {
+            DF_ERROR("light round trip failed");
+            abort();
+        }
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+    std::vector<LoopLoad> loads = server->loopLoads();
+    stop = true;
+    for (auto &t : heavy_threads)
+    {
+        t.join();
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+    printf("%-18s requests %7zu  p50 %8.0fus  p99 %8.0fus  p99.9 %8.0fus  max %8.0fus  conns/busy%%:",
+           name, samples.size(), pct(0.50), pct(0.99), pct(0.999), samples.back());
+    for (size_t i = 1; i < loads.size(); i++)
+    {
+        printf(" %zu/%u", loads[i].connections, loads[i].busy_permille / 10);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+    int heavy_us = argc > 2 ? atoi(argv[2]) : 2000;
+    g_spin = argc > 3 && strcmp(argv[3], "spin") == 0;
+
+    runPolicy("round-robin", ASSIGN_ROUND_ROBIN, BASE_PORT, seconds, heavy_us);
+    runPolicy("least-connections", ASSIGN_LEAST_CONNECTIONS, BASE_PORT + 1, seconds, heavy_us);
+    runPolicy("power-of-two", ASSIGN_POWER_OF_TWO, BASE_PORT + 2, seconds, heavy_us);
+    runPolicy("ip-hash", ASSIGN_IP_HASH, BASE_PORT + 3, seconds, heavy_us);
+    _exit(0);
+}
@@ -0,0 +1,167 @@
+#include "../http/http.hh"
+
+// 分隔符扫描：ByteScan各级实现（逐字节、SSE2、AVX2）的对比
+// 1. 按行读取：大首部（几KB的Cookie、Authorization等）按1460字节分段到达，每到一段就用getLine取出所有完整的行
+//    对照组是原来的getLine：每次都用memmem从读偏移重新查找
+// 2. HTTP首部解析：大首部的请求（整体到达、分段到达），以及大量流水线小请求
+// 用法: ./scan_bench [每项的重复次数]
+
+static const size_t SEGMENT_LEN = 1460;
+
+// 大首部：几个长字段值加上一些常见的短字段
+static std::string bigHead()
+{
+    std::string head = "GET /api/v1/profile?tab=settings HTTP/1.1\r\n"
+                       "Host: www.example.com\r\n"
+                       "Connection: keep-alive\r\n"
+                       "Accept: application/json\r\n";
+    head += "Cookie: ";
+    for (int i = 0; i < 64; i++)
+    {
+        head += "tracking_" + std::to_string(i) + "=8f14e45fceea167a5a36dedd4bea2543a87ff679; ";
+    }
+    head += "session=1\r\n";
+    head += "Authorization: Bearer " + std::string(1200, 'J') + "\r\n";
+    head += "X-Forwarded-For: 10.0.0.1, 10.0.0.2, 10.0.0.3\r\n";
+    head += "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n";
+    head += "X-Client-State: " + std::string(2048, 's') + "\r\n";
+    head += "\r\n";
+    return head;
+}
+
+static const char *SMALL_REQUEST = "GET /healthz HTTP/1.1\r\n"
+                                   "Host: 10.0.0.12:8080\r\n"
+                                   "Connection: keep-alive\r\n"
+                                   "\r\n";
+
+// 对照检查：每级实现在各种起点和长度上与逐字节实现的结果相同
+static void verify()
+{
+    std::string data(4096, 'a');
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = "ab \t:\r\n\x7f\x01z"[(i * 7919) % 10];
+    }
+    std::vector<ByteScan::Level> levels = {ByteScan::SCALAR, ByteScan::SSE2, ByteScan::AVX2};
+    for (size_t off = 0; off < 64; off++)
+    {
+        for (size_t len = 0; off + len <= 256; len++)
+        {
+            const char *p = data.data() + off;
+            ByteScan::setLevel(ByteScan::SCALAR);
+            size_t crlf = ByteScan::findCRLF(p, len), ctl = ByteScan::findCtl(p, len);
+            for (auto level : levels)
+            {
+                ByteScan::setLevel(level);
+                if (ByteScan::findCRLF(p, len) != crlf || ByteScan::findCtl(p, len) != ctl)
+                {
+                    fprintf(stderr, "%s: mismatch at offset %zu length %zu\n", ByteScan::levelName(ByteScan::level()), off, len);
+                    abort();
+                }
+            }
+        }
+    }
+    printf("verify: all levels agree with the scalar scan\n");
+}
+
+// 原来的getLine：每次从读偏移开始用memmem查找
+static std::string legacyGetLine(Buffer &buffer)
+{
+    if (buffer.empty())
+    {
+        return "";
+    }
+    char *crlf = static_cast<char *>(memmem(buffer.readPos(), buffer.readableBytes(), "\r\n", 2));
+    if (crlf == nullptr)
+    {
+        return "";
+    }
+    return buffer.readAsString(crlf - buffer.readPos() + 2);
+}
+
+template <class GetLine>
+static double benchLines(const std::string &head, size_t rounds, GetLine getLine)
+{
+    Buffer buf;
+    size_t lines = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++)
+    {
+        for (size_t off = 0; off < head.size(); off += SEGMENT_LEN)
+        {
+            buf.write(head.data() + off, std::min(SEGMENT_LEN, head.size() - off));
+            while (!getLine(buf).empty())
+            {
+                lines++;
+            }
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    if (!buf.empty() || lines == 0)
+    {
+        fprintf(stderr, "getLine left %zu bytes\n", buf.readableBytes());
+        abort();
+    }
+    return ns / rounds;
+}
+
+// 解析count个请求（每次写入fragment字节），返回每个请求的纳秒数
+static double benchParse(const std::string &req, size_t count, size_t fragment)
+{
+    HttpContext ctx;
+    Buffer buf;
+    size_t done = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t off = 0; off < req.size(); off += fragment)
+        {
+            buf.write(req.data() + off, std::min(fragment, req.size() - off));
+            ctx.recvAndParseRequest(buf);
+            while (ctx.getParseStat() == PARSE_FINISHED)
+            {
+                ctx.reset();
+                done++;
+                if (buf.empty())
+                {
+                    break;
+                }
+                ctx.recvAndParseRequest(buf);
+            }
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    if (done != count)
+    {
+        fprintf(stderr, "parsed %zu of %zu requests (status %d)\n", done, count, ctx.getRespStatCode());
+        abort();
+    }
+    return ns / count;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rounds = argc > 1 ? atol(argv[1]) : 20000;
+    ByteScan::Level best = ByteScan::level();
+    verify();
+
+    std::string head = bigHead();
+    std::string small = SMALL_REQUEST;
+    printf("head %zu bytes in %zu-byte segments, small request %zu bytes\n", head.size(), SEGMENT_LEN, small.size());
+    printf("%-8s %14s %14s %14s %14s\n", "scan", "getLine(ns)", "head(ns)", "head seg(ns)", "small(ns)");
+    printf("%-8s %14.0f %14s %14s %14s\n", "memmem", benchLines(head, rounds, legacyGetLine), "-", "-", "-");
+    for (auto level : {ByteScan::SCALAR, ByteScan::SSE2, ByteScan::AVX2})
+    {
+        if (level > best)
+        {
+            break;
+        }
+        ByteScan::setLevel(level);
+        double lines = benchLines(head, rounds, [](Buffer &buf) { return buf.getLine("\r\n"); });
+        double whole = benchParse(head, rounds, SIZE_MAX);
+        double pieces = benchParse(head, rounds, SEGMENT_LEN);
+        double pipelined = benchParse(small, rounds * 20, SIZE_MAX);
+        printf("%-8s %14.0f %14.0f %14.0f %14.0f\n", ByteScan::levelName(level), lines, whole, pieces, pipelined);
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "../src/server.hh"
+#include <netinet/tcp.h>
+
+// 各套接字调优参数（SocketOptions）对回显服务器的影响
+// 每种配置启动一个回显服务器，分别测量三项：
+// 1. 往返延迟：客户端（不关Nagle）把64字节的请求分两次写，服务器收齐后先回一半，发完再回另一半
+//    两边都是“写-写-读”，延迟确认和Nagle算法互相等待时会出现几十毫秒的停顿
+// 2. 吞吐量：4个连接持续回显64KB的数据块
+// 3. 短连接：建立连接、一次往返、关闭
+// 用法: ./sockopt_bench [每项的测量秒数]
+
+static const uint16_t BASE_PORT = 8950;
+static const size_t MSG_LEN = 64;
+static const size_t BLOCK_LEN = 64 * 1024;
+static const int BULK_CONNS = 4;
+
+struct Profile
+{
+    const char *name;
+    SocketOptions opts;
+};
+
+static std::vector<Profile> profiles()
+{
+    std::vector<Profile> list;
+    SocketOptions opts;
+    list.push_back({"default", opts});
+    opts = SocketOptions();
+    opts.no_delay = true;
+    list.push_back({"no_delay", opts});
+    opts = SocketOptions();
+    opts.quick_ack = true;
+    list.push_back({"quick_ack", opts});
+    opts = SocketOptions();
+    opts.no_delay = true;
+    opts.quick_ack = true;
+    list.push_back({"no_delay+quick_ack", opts});
+    opts = SocketOptions();
+    opts.send_buffer = 4 << 20;
+    opts.recv_buffer = 4 << 20;
+    list.push_back({"buffers 4MB", opts});
+    opts = SocketOptions();
+    opts.send_buffer = 16 << 10;
+    opts.recv_buffer = 16 << 10;
+    list.push_back({"buffers 16KB", opts});
+    opts = SocketOptions();
+    opts.defer_accept_sec = 1;
+    list.push_back({"defer_accept", opts});
+    opts = SocketOptions();
+    opts.fastopen_queue = 256;
+    list.push_back({"fastopen", opts});
+    opts = SocketOptions();
+    opts.busy_poll_us = 50;
+    list.push_back({"busy_poll 50us", opts});
+    opts = SocketOptions();
+    opts.user_timeout_ms = 10000;
+    opts.keepalive_idle_sec = 60;
+    opts.keepalive_interval_sec = 10;
+    opts.keepalive_count = 3;
+    list.push_back({"keepalive+timeout", opts});
+    return list;
+}
+
+static void startServer(uint16_t port, const SocketOptions &opts)
+{
+    std::mutex mtx;
+    std::condition_variable cond;
+    bool ready = false;
+    std::thread([&, port, opts]() {
+        TcpServer svr(port);
+        svr.setThreadCount(1);
+        svr.setSocketOptions(opts);
+        svr.setConnectedCallback([](const PtrConnection &conn) { conn->setContext(std::string()); });
+        svr.setMessageCallback([](const PtrConnection &conn, Buffer &buf) {
+            // 吞吐量测试的数据块（'B'）直接回显
+            if (*buf.readPos() == 'B')
+            {
+                size_t len = buf.readableBytes();
+                conn->send((const char *)buf.readPos(), len);
+                buf.moveReadIdx(len);
+                return;
+            }
+            // 收齐一条消息后先回一半，剩下的一半等前一半发送完毕后再回
+            while (buf.readableBytes() >= MSG_LEN)
+            {
+                std::string msg((const char *)buf.readPos(), MSG_LEN);
+                buf.moveReadIdx(MSG_LEN);
+                conn->send(msg.c_str(), MSG_LEN / 2);
+                conn->setContext(msg.substr(MSG_LEN / 2));
+            }
+        });
+        svr.setWriteCompleteCallback([](const PtrConnection &conn) {
+            std::string *rest = conn->getContext()->get<std::string>();
+            if (!rest->empty())
+            {
+                std::string data;
+                data.swap(*rest);
+                conn->send(data.c_str(), data.size());
+            }
+        });
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            ready = true;
+            cond.notify_all();
+        }
+        svr.start();
+    }).detach();
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [&]() { return ready; });
+    usleep(100 * 1000);
+}
+
+static int connectTo(uint16_t port, bool fastopen)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+#ifdef TCP_FASTOPEN_CONNECT
+    if (fastopen)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one));
+    }
+#endif
+    struct sockaddr_in svr = {};
+    svr.sin_family = AF_INET;
+    svr.sin_port = htons(port);
+    svr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&svr, sizeof(svr)) < 0)
+    {
+        DF_ERROR("connect failed: %s", strerror(errno));
+        abort();
+    }
+    return fd;
+}
+
+static bool recvAll(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t ret = recv(fd, buf + got, len - got, 0);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        got += ret;
+    }
+    return true;
+}
+
+// 一次请求：分两次写，读回完整的响应
+static bool request(int fd)
+{
+    char buf[MSG_LEN];
+    memset(buf, 'x', sizeof(buf));
+    if (send(fd, buf, MSG_LEN / 2, 0) != MSG_LEN / 2 || send(fd, buf + MSG_LEN / 2, MSG_LEN / 2, 0) != MSG_LEN / 2)
+    {
+        return false;
+    }
+    return recvAll(fd, buf, MSG_LEN);
+}
+
+static double pct(std::vector<double> &samples, double p)
+{
+    return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))];
+}
+
+static void benchLatency(uint16_t port, int seconds, double *p50, double *p99)
+{
+    int fd = connectTo(port, false);
+    std::vector<double> samples;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!request(fd))
+        {
+            DF_ERROR("latency request failed");
+            abort();
+        }
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+    close(fd);
+    std::sort(samples.begin(), samples.end());
+    *p50 = pct(samples, 0.50);
+    *p99 = pct(samples, 0.99);
+}
+
+static double benchThroughput(uint16_t port, int seconds)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> bytes(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < BULK_CONNS; i++)
+    {
+        threads.emplace_back([&]() {
+            int fd = connectTo(port, false);
+            std::vector<char> block(BLOCK_LEN, 'B');
+            std::vector<char> buf(BLOCK_LEN);
+            while (!stop)
+            {
+                if (send(fd, block.data(), block.size(), 0) != (ssize_t)block.size() || !recvAll(fd, buf.data(), buf.size()))
+                {
+                    DF_ERROR("bulk echo failed");
+                    abort();
+                }
+                bytes.fetch_add(BLOCK_LEN, std::memory_order_relaxed);
+            }
+            close(fd);
+        });
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    sleep(seconds);
+    stop = true;
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return bytes.load() / elapsed / (1 << 20);
+}
+
+static double benchShortConnections(uint16_t port, int seconds, bool fastopen)
+{
+    long count = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    auto end = t0 + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        int fd = connectTo(port, fastopen);
+        if (!request(fd))
+        {
+            DF_ERROR("short connection request failed");
+            abort();
+        }
+        close(fd);
+        count++;
+    }
+    return count / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 2;
+
+    printf("%-20s %10s %10s %12s %12s\n", "profile", "p50(us)", "p99(us)", "echo(MB/s)", "conn/s");
+    std::vector<Profile> list = profiles();
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        uint16_t port = BASE_PORT + i;
+        startServer(port, list[i].opts);
+        double p50, p99;
+        benchLatency(port, seconds, &p50, &p99);
+        double mbps = benchThroughput(port, seconds);
+        double rate = benchShortConnections(port, seconds, list[i].opts.fastopen_queue > 0);
+        printf("%-20s %10.0f %10.0f %12.0f %12.0f\n", list[i].name, p50, p99, mbps, rate);
+        fflush(stdout);
+    }
+    _exit(0);
+}
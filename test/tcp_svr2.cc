@@ -49,12 +49,12 @@ void HandleError(Channel *conn_channel)
 {
     HandleClose(conn_channel);
 }
-void HandleAny(Channel *conn_channel, EventLoop *looper)
+void HandleAny(Channel *conn_channel, EventLoop *looper, TimerId timer)
 {
     DF_DEBUG("有事件发生了");
     
     //活跃连接刷新
-    looper->resetTimer(conn_channel->Fd());
+    looper->resetTimer(timer);
 }
 
 void HandleInactive(Channel *conn_channel)
@@ -83,10 +83,10 @@ void AcceptHandler(Channel *listen_channel, EventLoop *looper)
     conn_channel->setWriteCallback(std::bind(HandleWrite, conn_channel));
     conn_channel->setErrorCallback(std::bind(HandleError, conn_channel));
     conn_channel->setCloseCallback(std::bind(HandleClose, conn_channel));
-    conn_channel->setAnyCallback(std::bind(HandleAny, conn_channel, looper));
 
-    // 非活跃连接超时释放
-    looper->addTimer(newfd, 10, std::bind(HandleInactive, conn_channel));
+    // 非活跃连接超时释放（10秒）
+    TimerId timer = looper->runAfter(10000, std::bind(HandleInactive, conn_channel));
+    conn_channel->setAnyCallback(std::bind(HandleAny, conn_channel, looper, timer));
 
     // 开启读事件监听
     conn_channel->enableRead();
@@ -111,7 +111,7 @@ int main()
     listen_channel.setReadCallback(std::bind(AcceptHandler, &listen_channel, &looper));
     listen_channel.enableRead();
 
-    // looper.addTimer(2025, 5, timer_task);
+    // looper.runAfter(5000, timer_task);
 
     while (true)
     {
@@ -14,7 +14,7 @@
 
 void OnConnected(const PtrConnection& conn)
 {
-    DF_DEBUG("Connection constructed, id: %d", conn->Id());
+    DF_DEBUG("Connection constructed, id: %" PRIu64, conn->Id());
 }
 void MessageHandler(const PtrConnection& conn, Buffer& buf)
 {
@@ -27,7 +27,7 @@ void MessageHandler(const PtrConnection& conn, Buffer& buf)
 }
 // void DestroyConnection(const PtrConnection& conn)
 // {
-//     DF_DEBUG("关闭连接, id: %d", conn->Id());
+//     DF_DEBUG("关闭连接, id: %" PRIu64, conn->Id());
 //     //服务器组件中删除连接
 //     conn_map.erase(conn->Id());
 // }